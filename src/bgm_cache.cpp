@@ -0,0 +1,198 @@
+#include "hook_mgr.hpp"
+#include "plugin.hpp"
+#include "bgm_cache.hpp"
+#include "sound_index.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace BGMCache
+{
+	// Enough to cover the first several seconds of even a high-rate FLAC, and
+	// a good way into an OGG
+	constexpr size_t WarmBytes = 4 * 1024 * 1024;
+
+	// Views come out of a 32-bit address space and up to three are held at
+	// once. A FLAC bigger than this only has its start mapped, to warm it, and
+	// CFLACFile reads it from disk as before.
+	constexpr size_t MaxMappedBytes = 32 * 1024 * 1024;
+
+	struct Entry
+	{
+		std::string track;
+		Resolved resolved;
+		std::shared_ptr<const MappedFile> file; // only kept for FLACs, which CFLACFile reads from it
+	};
+
+	static std::mutex Mutex;
+	static std::condition_variable Wake;
+	static std::vector<std::string> Wanted;
+	static uint64_t WantedGeneration = 0;
+	static std::vector<Entry> Entries;
+	static bool ThreadStarted = false;
+
+	MappedFile::~MappedFile()
+	{
+		if (data_)
+			UnmapViewOfFile(data_);
+		if (mapping_)
+			CloseHandle(mapping_);
+		if (file_)
+			CloseHandle(file_);
+	}
+
+	bool MappedFile::open(const std::filesystem::path& path, size_t maxBytes)
+	{
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		file_ = file;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+			return false;
+
+		mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping_)
+			return false;
+
+		const size_t length = size_t(min(uint64_t(size.QuadPart), uint64_t(maxBytes)));
+		data_ = (const uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, length);
+		if (!data_)
+			return false;
+
+		size_ = length;
+		whole_ = uint64_t(size.QuadPart) == length;
+		return true;
+	}
+
+	// Touches a byte of every page at the start of the file, so the OS reads
+	// it in now rather than when playback starts
+	static void Warm(const MappedFile& file)
+	{
+		constexpr size_t PageSize = 4096;
+
+		const size_t end = min(file.size(), WarmBytes);
+		volatile uint8_t sink = 0;
+		for (size_t offset = 0; offset < end; offset += PageSize)
+			sink += file.data()[offset];
+	}
+
+	Resolved Resolve(const std::filesystem::path& fileName, FileType requested)
+	{
+		// If a .flac or .wav file exists with the same filename, the loader uses that instead
+		std::filesystem::path fileNameAsFlac = fileName;
+		fileNameAsFlac = fileNameAsFlac.replace_extension(".flac");
+		std::filesystem::path fileNameAsWav = fileName;
+		fileNameAsWav = fileNameAsWav.replace_extension(".wav");
+
+		if (Settings::AllowFLAC && SoundIndex::Exists(fileNameAsFlac))
+			return { fileNameAsFlac.string(), FileType::FLAC };
+		if (Settings::AllowWAV && SoundIndex::Exists(fileNameAsWav))
+			return { fileNameAsWav.string(), FileType::WAV };
+
+		return { fileName.string(), requested };
+	}
+
+	bool ResolveTrack(const std::string& track, FileType requested, Resolved& resolved)
+	{
+		std::string path = track;
+		if (!SoundIndex::Exists(path))
+			path = ".\\Sound\\" + track;
+
+		if (!SoundIndex::Exists(path))
+			return false;
+
+		resolved = Resolve(path, requested);
+		return true;
+	}
+
+	static void CacheThread()
+	{
+		uint64_t seen = 0;
+		for (;;)
+		{
+			std::vector<std::string> wanted;
+			{
+				std::unique_lock lock(Mutex);
+				Wake.wait(lock, [&] { return WantedGeneration != seen; });
+				seen = WantedGeneration;
+				wanted = Wanted;
+
+				std::erase_if(Entries, [&](const Entry& entry) {
+					return std::find(wanted.begin(), wanted.end(), entry.track) == wanted.end();
+				});
+			}
+
+			for (const auto& track : wanted)
+			{
+				{
+					std::lock_guard lock(Mutex);
+					if (WantedGeneration != seen)
+						break; // switched again, start over with the new set
+
+					const bool cached = std::any_of(Entries.begin(), Entries.end(), [&](const Entry& entry) {
+						return entry.track == track;
+					});
+					if (cached)
+						continue;
+				}
+
+				Entry entry;
+				entry.track = track;
+				if (!ResolveTrack(track, FileType::OGG, entry.resolved))
+					continue;
+
+				auto file = std::make_shared<MappedFile>();
+				if (file->open(entry.resolved.path, MaxMappedBytes))
+				{
+					Warm(*file);
+					if (entry.resolved.type == FileType::FLAC && file->whole())
+						entry.file = std::move(file);
+				}
+
+				spdlog::debug("BGMCache: cached {}", entry.resolved.path);
+
+				std::lock_guard lock(Mutex);
+				Entries.push_back(std::move(entry));
+			}
+		}
+	}
+
+	void Prefetch(const std::vector<std::string>& tracks)
+	{
+		std::lock_guard lock(Mutex);
+		Wanted = tracks;
+		WantedGeneration++;
+
+		if (!ThreadStarted)
+		{
+			std::thread(CacheThread).detach();
+			ThreadStarted = true;
+		}
+
+		Wake.notify_one();
+	}
+
+	bool FindTrack(const std::string& track, Resolved& resolved)
+	{
+		std::lock_guard lock(Mutex);
+		for (const auto& entry : Entries)
+			if (entry.track == track)
+			{
+				resolved = entry.resolved;
+				return true;
+			}
+		return false;
+	}
+
+	std::shared_ptr<const MappedFile> FindFile(const std::string& path)
+	{
+		std::lock_guard lock(Mutex);
+		for (const auto& entry : Entries)
+			if (entry.file && entry.resolved.path == path)
+				return entry.file;
+		return nullptr;
+	}
+}
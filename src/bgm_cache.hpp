@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Keeps the CD switcher's neighbouring tracks ready so switching to one
+// doesn't stall on the disk. A background thread works out which file the BGM
+// loader would open for each track, maps it, and reads in its first few MB so
+// the OS has them cached. CFLACFile opens mapped FLACs straight from memory;
+// WAV and OGG still go through the game's own loaders, but find their file
+// already cached.
+namespace BGMCache
+{
+	// Same values as the game's CWaveFile type selector
+	enum class FileType
+	{
+		WAV = 1,
+		FLAC = 2,
+		OGG = 3
+	};
+
+	struct Resolved
+	{
+		std::string path; // as handed to the game's loader
+		FileType type = FileType::OGG;
+	};
+
+	// A file mapped read-only, or its first maxBytes if it's bigger than that.
+	// Holders keep the view alive after the cache has moved on to other tracks.
+	class MappedFile
+	{
+		void* file_ = nullptr;
+		void* mapping_ = nullptr;
+		const uint8_t* data_ = nullptr;
+		size_t size_ = 0;
+		bool whole_ = false;
+
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		bool open(const std::filesystem::path& path, size_t maxBytes);
+
+		const uint8_t* data() const { return data_; }
+		size_t size() const { return size_; } // of the view
+		bool whole() const { return whole_; }
+	};
+
+	// Which file the BGM loader ends up opening for the given file, given the
+	// type the game asked for: a .flac or .wav beside it if those are allowed.
+	Resolved Resolve(const std::filesystem::path& fileName, FileType requested);
+
+	// Same for a CDTracks entry, which may also be relative to the Sound
+	// folder. False if the track's file doesn't exist in either place.
+	bool ResolveTrack(const std::string& track, FileType requested, Resolved& resolved);
+
+	// Replaces the set of tracks to keep ready. Returns immediately, the work
+	// happens on the cache thread.
+	void Prefetch(const std::vector<std::string>& tracks);
+
+	// A track resolved by an earlier Prefetch, if it's finished being cached
+	bool FindTrack(const std::string& track, Resolved& resolved);
+
+	// The mapping of a resolved path, if it's one of the cached tracks
+	std::shared_ptr<const MappedFile> FindFile(const std::string& path);
+}
@@ -17,6 +17,7 @@ namespace Module
 	constexpr std::string_view IniFileName = "OutRun2006Tweaks.ini";
 	constexpr std::string_view UserIniFileName = "OutRun2006Tweaks.user.ini";
 	constexpr std::string_view LodIniFileName = "OutRun2006Tweaks.lods.ini";
+	constexpr std::string_view DrawDistIniFileName = "OutRun2006Tweaks.drawdist.ini";
 	constexpr std::string_view OverlayIniFileName = "OutRun2006Tweaks.overlay.ini";
 	constexpr std::string_view BindingsIniFileName = "OutRun2006Tweaks.input.ini";
 	constexpr std::string_view LogFileName = "OutRun2006Tweaks.log";
@@ -38,6 +39,7 @@ namespace Module
 		IniPath = dllParent / IniFileName;
 		UserIniPath = dllParent / UserIniFileName;
 		LodIniPath = dllParent / LodIniFileName;
+		DrawDistIniPath = dllParent / DrawDistIniFileName;
 		OverlayIniPath = dllParent / OverlayIniFileName;
 		BindingsIniPath = dllParent / BindingsIniFileName;
 
@@ -157,6 +159,8 @@ BOOL APIENTRY DllMain(HMODULE hModule, int ul_reason_for_call, LPVOID lpReserved
 	}
 	else if (ul_reason_for_call == DLL_PROCESS_DETACH)
 	{
+		// Only writes an INI, nothing that would wait on the loader lock
+		DrawDist_Shutdown();
 		proxy::on_detach();
 	}
 
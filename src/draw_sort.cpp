@@ -0,0 +1,63 @@
+#include "draw_sort.hpp"
+#include <utility>
+
+bool DrawSort::SortCoherent(Item* items, int count)
+{
+	int budget = count * 4;
+	for (int i = 1; i < count; i++)
+	{
+		const Item item = items[i];
+		int j = i;
+		for (; j > 0 && Before(item, items[j - 1]); j--)
+			items[j] = items[j - 1];
+		items[j] = item;
+
+		budget -= i - j;
+		if (budget < 0)
+			return false;
+	}
+
+	return true;
+}
+
+void DrawSort::SortRadix(Item* items, Item* scratch, int count)
+{
+	if (count < 2)
+		return;
+
+	uint32_t histograms[4][256] = {};
+	for (int i = 0; i < count; i++)
+	{
+		const uint32_t key = items[i].key;
+		histograms[0][key & 0xFF]++;
+		histograms[1][(key >> 8) & 0xFF]++;
+		histograms[2][(key >> 16) & 0xFF]++;
+		histograms[3][key >> 24]++;
+	}
+
+	Item* src = items;
+	Item* dst = scratch;
+	for (int pass = 0; pass < 4; pass++)
+	{
+		uint32_t* histogram = histograms[pass];
+		const int shift = pass * 8;
+		if (histogram[(src[0].key >> shift) & 0xFF] == uint32_t(count))
+			continue;
+
+		uint32_t offset = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			const uint32_t n = histogram[b];
+			histogram[b] = offset;
+			offset += n;
+		}
+
+		for (int i = 0; i < count; i++)
+			dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+		std::swap(src, dst);
+	}
+
+	if (src != items)
+		memcpy(items, src, count * sizeof(Item));
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// The two fast paths StableDrawSort orders the stage draw list with, on keys
+// already turned into sortable integers. Both give exactly the order of a
+// comparison sort on (float key, queue index), which is what the game's list
+// gets when it's in queue order. Nothing here touches Windows or the game, so
+// the drawsortbench tool builds it as well.
+namespace DrawSort
+{
+	struct Item
+	{
+		uint32_t key;
+		uint32_t index; // position the entry was queued at, the tie-break
+	};
+
+	// A float as an unsigned integer that orders the same way. Flipping the
+	// sign bit orders positives above negatives, and inverting the rest of a
+	// negative reverses their magnitudes. -0.0 is folded into 0.0 first, which
+	// compare equal as floats.
+	inline uint32_t SortableKey(float key)
+	{
+		uint32_t bits;
+		memcpy(&bits, &key, sizeof(bits));
+		if (bits == 0x80000000)
+			bits = 0;
+		return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+	}
+
+	inline bool Before(const Item& a, const Item& b)
+	{
+		if (a.key != b.key)
+			return a.key < b.key;
+		return a.index < b.index;
+	}
+
+	// Insertion sort, for items filled in last frame's order. Cheap while only
+	// a few entries swap places, so it gives up once it has shifted more than a
+	// few per entry, leaving items partly sorted for the caller to redo.
+	bool SortCoherent(Item* items, int count);
+
+	// LSD radix sort on the keys, a byte at a time. Each pass is stable, so
+	// items with equal keys keep the order they went in, and items filled in
+	// queue order come out tie-broken by index. Passes where every key has the
+	// same byte are skipped. scratch needs room for count items.
+	void SortRadix(Item* items, Item* scratch, int count);
+}
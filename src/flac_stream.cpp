@@ -0,0 +1,632 @@
+#include "flac_stream.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLAC_STREAM_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// libFLAC never hands back a sample wider than the frame's bit depth, so
+	// 16-bit output needs no clamping.
+	template <unsigned Bytes>
+	inline void store_sample(uint8_t* out, FLAC__int32 sample)
+	{
+		if constexpr (Bytes == 2)
+		{
+			const int16_t pcm = int16_t(sample);
+			memcpy(out, &pcm, sizeof(pcm));
+		}
+		else if constexpr (Bytes == 3)
+		{
+			out[0] = uint8_t(sample);
+			out[1] = uint8_t(sample >> 8);
+			out[2] = uint8_t(sample >> 16);
+		}
+		else
+			memcpy(out, &sample, sizeof(sample));
+	}
+
+	template <unsigned Channels, unsigned Bytes>
+	void interleave(uint8_t* out, const FLAC__int32* const buffer[], unsigned blocksize, unsigned start)
+	{
+		out += start * Channels * Bytes;
+		for (unsigned i = start; i < blocksize; i++)
+			for (unsigned channel = 0; channel < Channels; channel++, out += Bytes)
+				store_sample<Bytes>(out, buffer[channel][i]);
+	}
+
+	template <unsigned Channels, unsigned Bytes>
+	void interleave(uint8_t* out, const FLAC__int32* const buffer[], unsigned blocksize)
+	{
+		interleave<Channels, Bytes>(out, buffer, blocksize, 0);
+	}
+
+#ifdef FLAC_STREAM_SSE2
+	// Stereo 16-bit, four frames at a time. packs saturates, but the samples
+	// are already in range.
+	template <>
+	void interleave<2, 2>(uint8_t* out, const FLAC__int32* const buffer[], unsigned blocksize)
+	{
+		unsigned i = 0;
+		for (; i + 4 <= blocksize; i += 4)
+		{
+			const __m128i left = _mm_loadu_si128((const __m128i*)(buffer[0] + i));
+			const __m128i right = _mm_loadu_si128((const __m128i*)(buffer[1] + i));
+			const __m128i lo = _mm_unpacklo_epi32(left, right);
+			const __m128i hi = _mm_unpackhi_epi32(left, right);
+			_mm_storeu_si128((__m128i*)(out + i * 4), _mm_packs_epi32(lo, hi));
+		}
+
+		interleave<2, 2>(out, buffer, blocksize, i);
+	}
+
+	// Stereo 24-bit, four frames at a time. Each 64-bit lane holds one frame's
+	// pair of samples, squeezed down to its 6 bytes and stored 8 wide, so every
+	// store runs 2 bytes into the next frame. The vector loop always leaves at
+	// least one frame for the scalar tail to overwrite that with.
+	template <>
+	void interleave<2, 3>(uint8_t* out, const FLAC__int32* const buffer[], unsigned blocksize)
+	{
+		const __m128i lowSample = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+		const __m128i highSample = _mm_set_epi32(0x0000FFFF, int(0xFF000000), 0x0000FFFF, int(0xFF000000));
+
+		const auto store_pairs = [&](uint8_t* dest, __m128i pairs)
+		{
+			const __m128i packed = _mm_or_si128(_mm_and_si128(pairs, lowSample),
+				_mm_and_si128(_mm_srli_epi64(pairs, 8), highSample));
+
+			_mm_storel_epi64((__m128i*)dest, packed);
+			_mm_storel_epi64((__m128i*)(dest + 6), _mm_srli_si128(packed, 8));
+		};
+
+		unsigned i = 0;
+		for (; i + 4 < blocksize; i += 4)
+		{
+			const __m128i left = _mm_loadu_si128((const __m128i*)(buffer[0] + i));
+			const __m128i right = _mm_loadu_si128((const __m128i*)(buffer[1] + i));
+			store_pairs(out + i * 6, _mm_unpacklo_epi32(left, right));
+			store_pairs(out + i * 6 + 12, _mm_unpackhi_epi32(left, right));
+		}
+
+		interleave<2, 3>(out, buffer, blocksize, i);
+	}
+#endif
+
+	template <unsigned Channels>
+	FLACStream::Kernel select_depth(unsigned bitsPerSample)
+	{
+		switch (bitsPerSample)
+		{
+		case 16: return interleave<Channels, 2>;
+		case 24: return interleave<Channels, 3>;
+		case 32: return interleave<Channels, 4>;
+		default: return nullptr;
+		}
+	}
+
+	// Value of a NAME=value comment, case-insensitive on the name like the
+	// Vorbis comment spec asks
+	bool tag_value(const char* tag, size_t length, const char* name, uint64_t& value)
+	{
+		const size_t nameLength = strlen(name);
+		if (length <= nameLength)
+			return false;
+
+		for (size_t i = 0; i < nameLength; i++)
+			if (toupper((unsigned char)tag[i]) != name[i])
+				return false;
+
+		const std::string text(tag + nameLength, length - nameLength);
+		char* end = nullptr;
+		value = strtoull(text.c_str(), &end, 10);
+		return end != text.c_str();
+	}
+}
+
+FLACStream::Kernel FLACStream::select_kernel(unsigned channels, unsigned bitsPerSample)
+{
+	switch (channels)
+	{
+	case 1: return select_depth<1>(bitsPerSample);
+	case 2: return select_depth<2>(bitsPerSample);
+	case 3: return select_depth<3>(bitsPerSample);
+	case 4: return select_depth<4>(bitsPerSample);
+	case 5: return select_depth<5>(bitsPerSample);
+	case 6: return select_depth<6>(bitsPerSample);
+	case 7: return select_depth<7>(bitsPerSample);
+	case 8: return select_depth<8>(bitsPerSample);
+	default: return nullptr;
+	}
+}
+
+bool FLACStream::create_decoder()
+{
+	decoder_ = FLAC__stream_decoder_new();
+	if (!decoder_)
+	{
+		error_ = "couldn't create decoder";
+		return false;
+	}
+
+	FLAC__stream_decoder_set_metadata_ignore_all(decoder_);
+	FLAC__stream_decoder_set_metadata_respond(decoder_, FLAC__METADATA_TYPE_STREAMINFO);
+	FLAC__stream_decoder_set_metadata_respond(decoder_, FLAC__METADATA_TYPE_VORBIS_COMMENT);
+	return true;
+}
+
+bool FLACStream::open_file(const char* path)
+{
+	close();
+	if (!create_decoder())
+		return false;
+
+	if (FLAC__stream_decoder_init_file(decoder_, path, write_callback, metadata_callback, error_callback, this) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+	{
+		error_ = std::string("failed to open ") + path;
+		return false;
+	}
+
+	return start();
+}
+
+bool FLACStream::open_memory(const uint8_t* data, size_t size)
+{
+	close();
+	memData_ = data;
+	memSize_ = size;
+	memPos_ = 0;
+
+	if (!create_decoder())
+		return false;
+
+	if (FLAC__stream_decoder_init_stream(decoder_, memory_read, memory_seek, memory_tell, memory_length, memory_eof,
+		write_callback, metadata_callback, error_callback, this) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+	{
+		error_ = "failed to start decoder";
+		return false;
+	}
+
+	return start();
+}
+
+bool FLACStream::start()
+{
+	if (!FLAC__stream_decoder_process_until_end_of_metadata(decoder_) || !format_.blockAlign)
+	{
+		error_ = "couldn't read STREAMINFO";
+		return false;
+	}
+
+	if (!kernel_)
+	{
+		error_ = "unsupported format, " + std::to_string(format_.channels) + " channels at " +
+			std::to_string(format_.bitsPerSample) + " bits";
+		return false;
+	}
+
+	if (loop_.enabled && !build_loop_cache())
+	{
+		error_ = "couldn't decode loop start, loop disabled";
+		loop_.enabled = false;
+		loopCache_.clear();
+		if (!seek_decoder(0))
+			return false;
+	}
+
+	build_head_cache();
+
+	size_t ringSize = std::max(size_t(format_.sampleRate) * format_.blockAlign * RingSeconds, ring_refill_bytes() * 2 + headCache_.size());
+	ringSize -= ringSize % format_.blockAlign;
+	ring_.resize(ringSize);
+
+	// The decoder carries on from the end of it, no seek needed
+	ring_write(headCache_.data(), headCache_.size());
+
+	worker_ = std::thread(&FLACStream::decode_worker, this);
+	return true;
+}
+
+void FLACStream::close()
+{
+	if (worker_.joinable())
+	{
+		{
+			std::lock_guard lock(mutex_);
+			stop_ = true;
+		}
+		spaceAvailable_.notify_one();
+		worker_.join();
+	}
+
+	if (decoder_)
+	{
+		FLAC__stream_decoder_finish(decoder_);
+		FLAC__stream_decoder_delete(decoder_);
+		decoder_ = nullptr;
+	}
+
+	format_ = {};
+	loop_ = {};
+	kernel_ = nullptr;
+	memData_ = nullptr;
+	memSize_ = 0;
+	memPos_ = 0;
+	frameData_.clear();
+	loopCache_.clear();
+	headCache_.clear();
+	ring_.clear();
+	ringRead_ = 0;
+	ringFilled_ = 0;
+	endOfStream_ = false;
+	resetPending_ = false;
+	stop_ = false;
+	underruns_ = 0;
+}
+
+size_t FLACStream::read(uint8_t* out, size_t size, std::chrono::milliseconds timeout)
+{
+	if (ring_.empty())
+		return 0;
+
+	size_t read = 0;
+
+	std::unique_lock lock(mutex_);
+	while (read < size)
+	{
+		if (!ringFilled_)
+		{
+			// Only happens if the worker fell behind, the head cache covers
+			// the start of the track after an open or reset
+			if (!endOfStream_)
+				underruns_++;
+
+			const auto ready = [this] { return ringFilled_ > 0 || endOfStream_; };
+			if (!dataAvailable_.wait_for(lock, timeout, ready) || !ringFilled_)
+				break;
+		}
+
+		const size_t contiguous = std::min(ringFilled_, ring_.size() - ringRead_);
+		const size_t toRead = std::min(contiguous, size - read);
+
+		memcpy(out + read, ring_.data() + ringRead_, toRead);
+		ringRead_ = (ringRead_ + toRead) % ring_.size();
+		ringFilled_ -= toRead;
+		read += toRead;
+	}
+
+	if (ring_free() >= ring_refill_bytes())
+		spaceAvailable_.notify_one();
+
+	return read;
+}
+
+void FLACStream::reset()
+{
+	std::lock_guard lock(mutex_);
+	ringRead_ = 0;
+	ringFilled_ = 0;
+	endOfStream_ = false;
+	resetPending_ = true;
+
+	// Playable straight away, the worker picks up after it
+	ring_write(headCache_.data(), headCache_.size());
+	spaceAvailable_.notify_one();
+}
+
+void FLACStream::ring_write(const uint8_t* data, size_t size)
+{
+	size_t writePos = (ringRead_ + ringFilled_) % ring_.size();
+	while (size)
+	{
+		const size_t toWrite = std::min(size, ring_.size() - writePos);
+		memcpy(ring_.data() + writePos, data, toWrite);
+		writePos = (writePos + toWrite) % ring_.size();
+		ringFilled_ += toWrite;
+		data += toWrite;
+		size -= toWrite;
+	}
+}
+
+// Queues the loop start cache, returning where the decoder should continue from
+uint64_t FLACStream::queue_loop()
+{
+	ring_write(loopCache_.data(), loopCache_.size());
+	return loop_.start + loopCache_.size() / format_.blockAlign;
+}
+
+// Moves frameData_ into the ring, cutting it off at the loop end. Returns a
+// sample to seek to if the loop end was reached.
+std::optional<uint64_t> FLACStream::queue_frame()
+{
+	const uint64_t frameSamples = frameData_.size() / format_.blockAlign;
+
+	if (loop_.enabled && frameSample_ + frameSamples >= loop_.end)
+	{
+		const uint64_t keep = loop_.end > frameSample_ ? loop_.end - frameSample_ : 0;
+		ring_write(frameData_.data(), size_t(keep) * format_.blockAlign);
+		frameData_.clear();
+		return queue_loop();
+	}
+
+	ring_write(frameData_.data(), frameData_.size());
+	frameData_.clear();
+	return std::nullopt;
+}
+
+// Seeks are sample accurate: the frame containing the sample is delivered to
+// write_callback starting at it.
+bool FLACStream::seek_decoder(uint64_t sample)
+{
+	frameData_.clear();
+	if (FLAC__stream_decoder_seek_absolute(decoder_, sample))
+		return true;
+
+	set_error("seek to sample " + std::to_string(sample) + " failed");
+	if (FLAC__stream_decoder_get_state(decoder_) == FLAC__STREAM_DECODER_SEEK_ERROR)
+		FLAC__stream_decoder_flush(decoder_);
+	return false;
+}
+
+// For errors raised while decoding, which happens on the worker once it's
+// started. Callers mustn't hold mutex_.
+void FLACStream::set_error(std::string error)
+{
+	std::lock_guard lock(mutex_);
+	error_ = std::move(error);
+}
+
+bool FLACStream::build_loop_cache()
+{
+	const uint64_t loopLength = loop_.end > loop_.start ? loop_.end - loop_.start : 0;
+	const size_t cacheBytes = size_t(std::min(uint64_t(format_.sampleRate / PrerollDivisor), loopLength)) * format_.blockAlign;
+
+	loopCache_.clear();
+	if (!cacheBytes || !seek_decoder(loop_.start))
+		return false;
+
+	while (loopCache_.size() < cacheBytes)
+	{
+		if (frameData_.empty())
+		{
+			if (FLAC__stream_decoder_get_state(decoder_) == FLAC__STREAM_DECODER_END_OF_STREAM ||
+				!FLAC__stream_decoder_process_single(decoder_))
+				return false;
+			continue;
+		}
+
+		const size_t toCopy = std::min(frameData_.size(), cacheBytes - loopCache_.size());
+		loopCache_.insert(loopCache_.end(), frameData_.begin(), frameData_.begin() + toCopy);
+		frameData_.clear();
+	}
+
+	return seek_decoder(0);
+}
+
+// Expects the decoder at the first sample. Unlike the loop cache this only
+// takes whole frames, so the decoder is left right where the cache ends.
+// Nothing here is fatal, without it reset just waits on the worker again.
+void FLACStream::build_head_cache()
+{
+	const size_t cacheBytes = size_t(format_.sampleRate / PrerollDivisor) * format_.blockAlign;
+
+	headCache_.clear();
+	while (headCache_.size() < cacheBytes)
+	{
+		if (frameData_.empty())
+		{
+			if (FLAC__stream_decoder_get_state(decoder_) == FLAC__STREAM_DECODER_END_OF_STREAM ||
+				!FLAC__stream_decoder_process_single(decoder_) || frameData_.empty())
+				break;
+			continue;
+		}
+
+		// A frame reaching the loop end stays in frameData_ for queue_frame
+		// to cut, the worker queues it first thing
+		const uint64_t frameSamples = frameData_.size() / format_.blockAlign;
+		if (loop_.enabled && frameSample_ + frameSamples >= loop_.end)
+			break;
+
+		headCache_.insert(headCache_.end(), frameData_.begin(), frameData_.end());
+		frameData_.clear();
+	}
+
+	// Whole track fits, reset would have nowhere to seek to after it
+	const uint64_t headSamples = headCache_.size() / format_.blockAlign;
+	if ((format_.totalSamples && headSamples >= format_.totalSamples) ||
+		FLAC__stream_decoder_get_state(decoder_) == FLAC__STREAM_DECODER_END_OF_STREAM)
+	{
+		headCache_.clear();
+		seek_decoder(0);
+	}
+}
+
+void FLACStream::decode_worker()
+{
+	for (;;)
+	{
+		std::optional<uint64_t> seekTo;
+		{
+			std::unique_lock lock(mutex_);
+			spaceAvailable_.wait(lock, [this] {
+				return stop_ || resetPending_ || (!endOfStream_ && ring_free() >= ring_refill_bytes());
+			});
+
+			if (stop_)
+				return;
+
+			if (resetPending_)
+			{
+				// Anything decoded before the reset is stale, reset already
+				// queued the head cache
+				resetPending_ = false;
+				seekTo = headCache_.size() / format_.blockAlign;
+			}
+			else if (!frameData_.empty())
+			{
+				seekTo = queue_frame();
+				dataAvailable_.notify_one();
+			}
+			else if (FLAC__stream_decoder_get_state(decoder_) == FLAC__STREAM_DECODER_END_OF_STREAM)
+			{
+				// A loop end past the last sample loops from the end instead
+				if (loop_.enabled)
+					seekTo = queue_loop();
+				else
+					endOfStream_ = true;
+				dataAvailable_.notify_one();
+			}
+		}
+
+		if (seekTo.has_value())
+		{
+			if (!seek_decoder(seekTo.value()))
+			{
+				std::lock_guard lock(mutex_);
+				endOfStream_ = true;
+				dataAvailable_.notify_one();
+			}
+			continue;
+		}
+
+		if (frameData_.empty() && FLAC__stream_decoder_get_state(decoder_) != FLAC__STREAM_DECODER_END_OF_STREAM &&
+			!FLAC__stream_decoder_process_single(decoder_))
+		{
+			std::lock_guard lock(mutex_);
+			error_ = std::string("decoding failed: ") + FLAC__StreamDecoderStateString[FLAC__stream_decoder_get_state(decoder_)];
+			endOfStream_ = true;
+			dataAvailable_.notify_one();
+		}
+	}
+}
+
+FLAC__StreamDecoderWriteStatus FLACStream::write_callback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* client_data)
+{
+	FLACStream* stream = static_cast<FLACStream*>(client_data);
+
+	const unsigned bps = frame->header.bits_per_sample;
+
+	// Frames are allowed to differ from STREAMINFO, though encoders don't do that
+	Kernel kernel = stream->kernel_;
+	if (frame->header.channels != stream->format_.channels || bps != stream->format_.bitsPerSample)
+		kernel = select_kernel(frame->header.channels, bps);
+
+	if (!kernel)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT; // Unsupported bit depth
+
+	// libFLAC hands us the sample number even for fixed-blocksize streams,
+	// and after a seek it's that of the sample seeked to
+	stream->frameSample_ = frame->header.number.sample_number;
+	stream->frameData_.resize(size_t(frame->header.blocksize) * frame->header.channels * (bps / 8));
+
+	kernel(stream->frameData_.data(), buffer, frame->header.blocksize);
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void FLACStream::metadata_callback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata, void* client_data)
+{
+	FLACStream* stream = static_cast<FLACStream*>(client_data);
+
+	if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
+	{
+		const auto& info = metadata->data.stream_info;
+
+		stream->format_.channels = info.channels;
+		stream->format_.sampleRate = info.sample_rate;
+		stream->format_.bitsPerSample = info.bits_per_sample;
+		stream->format_.blockAlign = (info.channels * info.bits_per_sample) / 8;
+		stream->format_.totalSamples = info.total_samples;
+
+		// The ring has to fit a whole frame whenever the worker decodes one
+		const unsigned maxBlockSize = info.max_blocksize ? info.max_blocksize : FLAC__MAX_BLOCK_SIZE;
+		stream->maxFrameBytes_ = size_t(maxBlockSize) * stream->format_.blockAlign;
+
+		stream->kernel_ = select_kernel(info.channels, info.bits_per_sample);
+	}
+	else if (metadata->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
+	{
+		std::optional<uint64_t> loop_start;
+		std::optional<uint64_t> loop_length;
+		std::optional<uint64_t> loop_end;
+		for (unsigned i = 0; i < metadata->data.vorbis_comment.num_comments; i++)
+		{
+			const char* tag = (const char*)metadata->data.vorbis_comment.comments[i].entry;
+			const size_t length = metadata->data.vorbis_comment.comments[i].length;
+
+			uint64_t value = 0;
+			if (tag_value(tag, length, "LOOPSTART=", value))
+				loop_start = value;
+			else if (tag_value(tag, length, "LOOPLENGTH=", value))
+				loop_length = value;
+			else if (tag_value(tag, length, "LOOPEND=", value))
+				loop_end = value;
+		}
+
+		if (loop_start.has_value() && loop_length.has_value())
+			loop_end = loop_start.value() + loop_length.value() - 1;
+
+		if (loop_start.has_value() && loop_end.has_value())
+		{
+			stream->loop_.start = loop_start.value();
+			stream->loop_.end = loop_end.value();
+			stream->loop_.enabled = true;
+		}
+	}
+}
+
+void FLACStream::error_callback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status, void* client_data)
+{
+	// Lost sync and the like, libFLAC carries on from the next frame it finds
+	FLACStream* stream = static_cast<FLACStream*>(client_data);
+	stream->set_error(std::string("decoding error: ") + FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+FLAC__StreamDecoderReadStatus FLACStream::memory_read(const FLAC__StreamDecoder* decoder, FLAC__byte buffer[], size_t* bytes, void* client_data)
+{
+	FLACStream* stream = static_cast<FLACStream*>(client_data);
+
+	const size_t remaining = stream->memSize_ - stream->memPos_;
+	if (!remaining)
+	{
+		*bytes = 0;
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	}
+
+	*bytes = std::min(*bytes, remaining);
+	memcpy(buffer, stream->memData_ + stream->memPos_, *bytes);
+	stream->memPos_ += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderSeekStatus FLACStream::memory_seek(const FLAC__StreamDecoder* decoder, FLAC__uint64 absolute_byte_offset, void* client_data)
+{
+	FLACStream* stream = static_cast<FLACStream*>(client_data);
+
+	if (absolute_byte_offset > stream->memSize_)
+		return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+
+	stream->memPos_ = size_t(absolute_byte_offset);
+	return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+FLAC__StreamDecoderTellStatus FLACStream::memory_tell(const FLAC__StreamDecoder* decoder, FLAC__uint64* absolute_byte_offset, void* client_data)
+{
+	*absolute_byte_offset = static_cast<FLACStream*>(client_data)->memPos_;
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+FLAC__StreamDecoderLengthStatus FLACStream::memory_length(const FLAC__StreamDecoder* decoder, FLAC__uint64* stream_length, void* client_data)
+{
+	*stream_length = static_cast<FLACStream*>(client_data)->memSize_;
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+FLAC__bool FLACStream::memory_eof(const FLAC__StreamDecoder* decoder, void* client_data)
+{
+	const FLACStream* stream = static_cast<FLACStream*>(client_data);
+	return stream->memPos_ >= stream->memSize_;
+}
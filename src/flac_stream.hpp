@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <FLAC/stream_decoder.h>
+
+// Decodes a FLAC into interleaved little-endian PCM, the way the game's BGM
+// player wants it, honouring LOOPSTART/LOOPLENGTH/LOOPEND tags. Nothing in
+// here is Windows specific, CFLACFile wraps it for the game and bgmbench
+// drives it directly.
+//
+// Decoded audio streams through a ring buffer a few seconds long, kept topped
+// up by a worker thread, so memory use doesn't depend on the track length.
+// The worker also handles looping: at the loop end it queues a copy of the
+// first part of the loop, decoded at open, and seeks the decoder to just past
+// it, so the seek has that long to finish without leaving a gap in the ring.
+// The start of the track is kept the same way, so opening and resetting fill
+// the ring straight away instead of making read wait on the decoder.
+class FLACStream
+{
+public:
+	static constexpr unsigned RingSeconds = 4;
+	static constexpr unsigned PrerollDivisor = 4; // quarter of a second of track and loop start
+
+	struct Format
+	{
+		unsigned channels = 0;
+		unsigned sampleRate = 0;
+		unsigned bitsPerSample = 0;
+		unsigned blockAlign = 0;    // bytes per sample frame
+		uint64_t totalSamples = 0;  // 0 if STREAMINFO doesn't say
+	};
+
+	// Samples from start up to but not including end are repeated forever
+	struct Loop
+	{
+		bool enabled = false;
+		uint64_t start = 0;
+		uint64_t end = 0;
+	};
+
+	using Kernel = void(*)(uint8_t* out, const FLAC__int32* const buffer[], unsigned blocksize);
+
+	// Converts a decoded frame's per-channel samples into interleaved PCM.
+	// There's a kernel per channel count and sample size, picked once from
+	// STREAMINFO, so none of them branch per sample. Null if unsupported.
+	static Kernel select_kernel(unsigned channels, unsigned bitsPerSample);
+
+	FLACStream() = default;
+	FLACStream(const FLACStream&) = delete;
+	FLACStream& operator=(const FLACStream&) = delete;
+	~FLACStream() { close(); }
+
+	bool open_file(const char* path);
+
+	// data has to stay valid until close
+	bool open_memory(const uint8_t* data, size_t size);
+
+	void close();
+
+	// Copies out up to size bytes of PCM. Only waits for the worker when the
+	// ring is empty, and then for at most timeout; a short read means it fell
+	// behind or the stream ended.
+	size_t read(uint8_t* out, size_t size, std::chrono::milliseconds timeout);
+
+	// Drops whatever's buffered and restarts from the first sample
+	void reset();
+
+	// Reads that found the ring empty before the end of the stream
+	unsigned underruns() const { return underruns_; }
+
+	const Format& format() const { return format_; }
+	const Loop& loop() const { return loop_; }
+
+	// Why the last open failed, or why the worker stopped early. A copy, as
+	// the worker can set it while the game thread is reading it.
+	std::string error() const
+	{
+		std::lock_guard lock(mutex_);
+		return error_;
+	}
+
+	// What the stream holds onto for decoding: ring, caches and frame
+	size_t memory_bytes() const { return ring_.capacity() + headCache_.capacity() + loopCache_.capacity() + frameData_.capacity(); }
+
+private:
+	FLAC__StreamDecoder* decoder_ = nullptr;
+
+	Format format_;
+	Loop loop_;
+	std::string error_; // under mutex_ once the worker is running
+	Kernel kernel_ = nullptr;
+
+	// Source for open_memory
+	const uint8_t* memData_ = nullptr;
+	size_t memSize_ = 0;
+	size_t memPos_ = 0;
+
+	// Decoder side, only touched by whoever is driving decoder_: open, then
+	// the worker thread
+	std::vector<uint8_t> frameData_; // last frame decoded, not yet queued
+	uint64_t frameSample_ = 0;       // sample number of its first sample
+	size_t maxFrameBytes_ = 0;
+	std::vector<uint8_t> loopCache_; // decoded from loop_.start onward
+	std::vector<uint8_t> headCache_; // decoded from the first sample, whole frames
+
+	// Shared with read, under mutex_
+	mutable std::mutex mutex_;
+	std::condition_variable spaceAvailable_;
+	std::condition_variable dataAvailable_;
+	std::vector<uint8_t> ring_;
+	size_t ringRead_ = 0;
+	size_t ringFilled_ = 0;
+	bool endOfStream_ = false;
+	bool resetPending_ = false;
+	bool stop_ = false;
+	std::atomic<unsigned> underruns_ = 0;
+
+	std::thread worker_;
+
+	bool create_decoder();
+	bool start();
+	void decode_worker();
+	bool seek_decoder(uint64_t sample);
+	void set_error(std::string error);
+	bool build_loop_cache();
+	void build_head_cache();
+	std::optional<uint64_t> queue_frame();
+	uint64_t queue_loop();
+	void ring_write(const uint8_t* data, size_t size);
+	size_t ring_free() const { return ring_.size() - ringFilled_; }
+	size_t ring_refill_bytes() const { return maxFrameBytes_ + loopCache_.size(); }
+
+	static FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* client_data);
+	static void metadata_callback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata, void* client_data);
+	static void error_callback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status, void* client_data);
+
+	static FLAC__StreamDecoderReadStatus memory_read(const FLAC__StreamDecoder* decoder, FLAC__byte buffer[], size_t* bytes, void* client_data);
+	static FLAC__StreamDecoderSeekStatus memory_seek(const FLAC__StreamDecoder* decoder, FLAC__uint64 absolute_byte_offset, void* client_data);
+	static FLAC__StreamDecoderTellStatus memory_tell(const FLAC__StreamDecoder* decoder, FLAC__uint64* absolute_byte_offset, void* client_data);
+	static FLAC__StreamDecoderLengthStatus memory_length(const FLAC__StreamDecoder* decoder, FLAC__uint64* stream_length, void* client_data);
+	static FLAC__bool memory_eof(const FLAC__StreamDecoder* decoder, void* client_data);
+};
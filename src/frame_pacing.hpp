@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+
+// What the update loop measures about its own scheduling, for the overlay
+// readouts. Written once per rendered frame by ReplaceGameUpdateLoop and read
+// by the overlay on the same thread, so nothing here is locked.
+namespace FramePacing
+{
+	// A reading that changes every frame is unreadable as text, so each one
+	// is gathered over a second and shown as that second's average and worst.
+	struct Window
+	{
+		float lastMs = 0.0f;
+		float avgMs = 0.0f;
+		float maxMs = 0.0f;
+		int samples = 0; // in the last completed second
+
+		// Accumulators for the second in progress.
+		double sumMs = 0.0;
+		float curMaxMs = 0.0f;
+		int curSamples = 0;
+
+		void add(float ms)
+		{
+			lastMs = ms;
+			sumMs += ms;
+			curMaxMs = ms > curMaxMs ? ms : curMaxMs;
+			curSamples++;
+		}
+
+		void publish()
+		{
+			avgMs = curSamples ? float(sumMs / curSamples) : 0.0f;
+			maxMs = curMaxMs;
+			samples = curSamples;
+
+			sumMs = 0.0;
+			curMaxMs = 0.0f;
+			curSamples = 0;
+		}
+	};
+
+	// Exponentially weighted mean and mean deviation, the way TCP estimates
+	// round-trip time. A frame that costs more than usual moves both, so a
+	// prediction built from them backs off within a frame or two and only
+	// creeps back down over a few dozen.
+	struct Estimate
+	{
+		float meanMs = 0.0f;
+		float devMs = 0.0f;
+
+		void add(float ms)
+		{
+			const float err = ms - meanMs;
+			meanMs += err * 0.125f;
+			devMs += ((err < 0.0f ? -err : err) - devMs) * 0.25f;
+		}
+
+		// What a frame should budget for this cost.
+		float budgetMs() const { return meanMs + 2.0f * devMs; }
+	};
+
+	struct State
+	{
+		// From the moment the frame's last tick sampled input to the moment
+		// that frame's Present returned. Frames that ran no tick showed no new
+		// input, so they don't add a sample.
+		Window inputToPresent;
+
+		// QPC time the most recent tick sampled input at.
+		int64_t inputSampleQpc = 0;
+
+		// Where a frame's CPU time goes, from the end of the limiter wait:
+		// running one game tick, the post-tick sprite replay and interpolation,
+		// the render path up to EndScene, and EndScene to Present returning.
+		// The last includes any wait for vsync.
+		Estimate tickCost;
+		Estimate interpCost;
+		Estimate drawCost;
+		Estimate presentCost;
+
+		// Everything a frame had to do outside the limiter wait: its ticks,
+		// interpolation, and rendering, with Present counted only when vsync is
+		// off. What the adaptive draw distance holds against its target.
+		Estimate frameWork;
+
+		// QPC time EndScene was reached, written by the overlay's EndScene hook.
+		int64_t endSceneQpc = 0;
+
+		// Adaptive limiter: ticks it expects the next frame to run, and how far
+		// ahead of the deadline it released the last frame so that it would
+		// reach Present on time.
+		int predictedTicks = 0;
+		float wakeLeadMs = 0.0f;
+
+		// Time between consecutive presents, and how far each landed from the
+		// limiter's deadline. Steady cadence shows as a small spread in both.
+		Window presentInterval;
+		Window presentError;
+
+		// How long the most recent load screen was up, and how much of its
+		// limiter time the main thread spent asleep on the loader thread
+		// rather than spinning.
+		float lastLoadMs = 0.0f;
+		float lastLoadWaitMs = 0.0f;
+
+		// SumoUISpriteReplay: what capturing on a tick frame and replaying on
+		// the rest cost, how much it holds, and how often a capture found the
+		// queue unchanged from the last.
+		Estimate spriteCaptureCost;
+		Estimate spriteReplayCost;
+		int spriteCapturedCount = 0;
+		int spriteCapturedBytes = 0;
+		int spriteCapturesTotal = 0;
+		int spriteCapturesUnchanged = 0;
+	};
+
+	inline State Stats;
+}
@@ -0,0 +1,568 @@
+#include "hook_mgr.hpp"
+#include "plugin.hpp"
+#include "game_addrs.hpp"
+#include "frame_telemetry.hpp"
+#include "overlay/overlay.hpp"
+#include "overlay/notifications.hpp"
+#include <imgui.h>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <format>
+
+namespace Telemetry
+{
+	// Rolling history for the graph and percentiles: a few seconds even at
+	// high framerates, short enough that a hitch scrolls out before long.
+	constexpr int HistoryLength = 2048;
+
+	static std::array<float, HistoryLength> FrameTimes{};
+	static int HistoryHead = 0; // next slot to write
+	static int HistoryCount = 0;
+
+	// Whole-run capture for the CSV dump, only filled while recording. A
+	// Frame is 64 bytes, so an hour at 144FPS is under 35MB.
+	static std::vector<Frame> Run;
+	static bool Recording = false;
+
+	void AddFrame(const Frame& frame)
+	{
+		FrameTimes[HistoryHead] = frame.frameMs;
+		HistoryHead = (HistoryHead + 1) % HistoryLength;
+		HistoryCount = min(HistoryCount + 1, HistoryLength);
+
+		if (Recording)
+			Run.push_back(frame);
+	}
+
+	static bool LatencyEnabled = false;
+
+	// Presses waiting on their tick to finish, then on their frame's Present.
+	// A frame runs at most a handful of ticks, so this never fills in practice.
+	struct PendingPress
+	{
+		int64_t pressQpc;
+		int64_t readQpc;
+		int64_t consumedQpc; // 0 until the tick has finished
+	};
+	static std::array<PendingPress, 16> Pending;
+	static int PendingCount = 0;
+
+	// Nothing real takes this long to reach the screen. A press older than
+	// this was left over from a pause or menu and would only be an outlier.
+	constexpr double StalePressMs = 1000.0;
+
+	// A sample split into where the time went: press to the tick reading it,
+	// the rest of that tick, then on to Present.
+	struct LatencySample
+	{
+		float totalMs;
+		float readMs;
+		float tickMs;
+		float presentMs;
+	};
+
+	// Every configuration seen this session. Past GroupCapacity a group's
+	// oldest samples are overwritten, which is still hours of steady driving.
+	constexpr size_t GroupCapacity = 65536;
+	struct LatencyGroup
+	{
+		LatencyConfig config;
+		std::vector<LatencySample> samples;
+		size_t next = 0; // slot the next sample goes in once full
+	};
+	static std::vector<LatencyGroup> Groups;
+	static int CurrentGroup = -1;
+
+	// Samples from the recorded run for the CSV, with the Run frame each was
+	// presented on. The config is copied rather than indexed so clearing the
+	// groups doesn't touch the run.
+	struct RunLatencySample
+	{
+		int frame;
+		LatencyConfig config;
+		LatencySample sample;
+	};
+	static std::vector<RunLatencySample> RunLatency;
+
+	static double QpcPerMs()
+	{
+		static const double perMs = []
+		{
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			return double(frequency.QuadPart) / 1000.0;
+		}();
+		return perMs;
+	}
+
+	bool LatencyActive()
+	{
+		return LatencyEnabled;
+	}
+
+	void InputPressed(int64_t pressQpc, int64_t readQpc)
+	{
+		if (LatencyEnabled && PendingCount < int(Pending.size()))
+			Pending[PendingCount++] = { pressQpc, readQpc, 0 };
+	}
+
+	void TickConsumed(int64_t qpc)
+	{
+		for (int i = 0; i < PendingCount; i++)
+			if (!Pending[i].consumedQpc)
+				Pending[i].consumedQpc = qpc;
+	}
+
+	static int FindGroup(const LatencyConfig& config)
+	{
+		for (size_t i = 0; i < Groups.size(); i++)
+			if (Groups[i].config == config)
+				return int(i);
+
+		Groups.push_back({ config });
+		return int(Groups.size() - 1);
+	}
+
+	void FramePresented(int64_t qpc, const LatencyConfig& config)
+	{
+		if (!LatencyEnabled || !PendingCount)
+			return;
+
+		CurrentGroup = FindGroup(config);
+		LatencyGroup& group = Groups[CurrentGroup];
+		const double perMs = QpcPerMs();
+
+		int kept = 0;
+		for (int i = 0; i < PendingCount; i++)
+		{
+			const PendingPress& press = Pending[i];
+			if (double(qpc - press.pressQpc) / perMs > StalePressMs)
+				continue;
+
+			if (!press.consumedQpc)
+			{
+				Pending[kept++] = press;
+				continue;
+			}
+
+			LatencySample sample;
+			sample.readMs = float(double(press.readQpc - press.pressQpc) / perMs);
+			sample.tickMs = float(double(press.consumedQpc - press.readQpc) / perMs);
+			sample.presentMs = float(double(qpc - press.consumedQpc) / perMs);
+			sample.totalMs = float(double(qpc - press.pressQpc) / perMs);
+
+			if (group.samples.size() < GroupCapacity)
+				group.samples.push_back(sample);
+			else
+			{
+				group.samples[group.next] = sample;
+				group.next = (group.next + 1) % GroupCapacity;
+			}
+
+			if (Recording)
+				RunLatency.push_back({ Run.empty() ? 0 : int(Run.size() - 1), config, sample });
+		}
+		PendingCount = kept;
+	}
+
+	static std::string ConfigLabel(const LatencyConfig& config)
+	{
+		static const char* modes[] = { "Efficient", "Accurate", "Adaptive" };
+
+		std::string label = config.limit > 0
+			? std::format("{} {}FPS", modes[std::clamp(config.limitMode, 0, 2)], config.limit)
+			: std::string("Unlimited");
+		if (config.vsync)
+			label += " vsync";
+		if (config.interpolation)
+			label += " interp";
+		if (config.lowLatency)
+			label += " low-latency";
+		if (config.samplingThread)
+			label += " 1kHz input";
+		return label;
+	}
+
+	struct LatencySummary
+	{
+		int presses = 0;
+		float p50 = 0.0f;
+		float p95 = 0.0f;
+		float p99 = 0.0f;
+		float worst = 0.0f;
+		float readMs = 0.0f; // averages of the parts
+		float tickMs = 0.0f;
+		float presentMs = 0.0f;
+	};
+
+	static LatencySummary SummariseLatency(const LatencyGroup& group)
+	{
+		LatencySummary summary;
+		const int count = int(group.samples.size());
+		if (!count)
+			return summary;
+
+		std::vector<float> sorted(count);
+		double read = 0.0, tick = 0.0, present = 0.0;
+		for (int i = 0; i < count; i++)
+		{
+			const LatencySample& sample = group.samples[i];
+			sorted[i] = sample.totalMs;
+			read += sample.readMs;
+			tick += sample.tickMs;
+			present += sample.presentMs;
+		}
+
+		std::sort(sorted.begin(), sorted.end());
+
+		auto percentile = [&](float p) { return sorted[min(int(p * count), count - 1)]; };
+
+		summary.presses = count;
+		summary.p50 = percentile(0.50f);
+		summary.p95 = percentile(0.95f);
+		summary.p99 = percentile(0.99f);
+		summary.worst = sorted.back();
+		summary.readMs = float(read / count);
+		summary.tickMs = float(tick / count);
+		summary.presentMs = float(present / count);
+		return summary;
+	}
+
+	// Percentiles over frame time, so p1 is the fast end and p99 the slow.
+	// The 1% low is the average framerate across the slowest 1% of frames,
+	// the figure benchmark tools usually quote.
+	struct Summary
+	{
+		int frames = 0;
+		float p1 = 0.0f;
+		float p50 = 0.0f;
+		float p99 = 0.0f;
+		float worst = 0.0f;
+		float avgFps = 0.0f;
+		float lowFps = 0.0f;
+	};
+
+	template <typename GetFrameTime>
+	static Summary Summarise(int count, GetFrameTime get)
+	{
+		Summary summary;
+		if (count <= 0)
+			return summary;
+
+		std::vector<float> sorted(count);
+		double total = 0.0;
+		for (int i = 0; i < count; i++)
+		{
+			sorted[i] = get(i);
+			total += sorted[i];
+		}
+
+		std::sort(sorted.begin(), sorted.end());
+
+		auto percentile = [&](float p) { return sorted[min(int(p * count), count - 1)]; };
+
+		summary.frames = count;
+		summary.p1 = percentile(0.01f);
+		summary.p50 = percentile(0.50f);
+		summary.p99 = percentile(0.99f);
+		summary.worst = sorted.back();
+
+		if (total > 0.0)
+			summary.avgFps = float(1000.0 * count / total);
+
+		const int lowCount = max(count / 100, 1);
+		double lowTotal = 0.0;
+		for (int i = count - lowCount; i < count; i++)
+			lowTotal += sorted[i];
+		if (lowTotal > 0.0)
+			summary.lowFps = float(1000.0 * lowCount / lowTotal);
+
+		return summary;
+	}
+
+	static Summary SummariseHistory()
+	{
+		return Summarise(HistoryCount, [](int i) { return FrameTimes[i]; });
+	}
+
+	static Summary SummariseRun()
+	{
+		return Summarise(int(Run.size()), [](int i) { return Run[i].frameMs; });
+	}
+
+	static std::filesystem::path DumpRun()
+	{
+		const auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+		tm local{};
+		localtime_s(&local, &now);
+
+		char stamp[32];
+		strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+
+		const auto folder = Module::DllPath.parent_path() / "telemetry";
+		std::error_code ec;
+		std::filesystem::create_directories(folder, ec);
+
+		const auto path = folder / std::format("frames_{}.csv", stamp);
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		if (!file.is_open())
+		{
+			spdlog::error("Telemetry::DumpRun - failed to open {} for writing", path.string());
+			return {};
+		}
+
+		file << "frame,time_ms,frame_ms,ticks,sleep_ms,tick_ms,interp_ms,draw_ms,present_ms,stage,section,nodes,excluded,objects,imm_entries,aft_entries,sort_ms,stage_draw_ms\n";
+
+		double time = 0.0;
+		for (size_t i = 0; i < Run.size(); i++)
+		{
+			const Frame& f = Run[i];
+			time += f.frameMs;
+			file << std::format("{},{:.3f},{:.3f},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{},{},{},{},{},{},{},{:.3f},{:.3f}\n",
+				i, time, f.frameMs, f.numUpdates, f.sleepMs, f.tickMs, f.interpMs, f.drawMs, f.presentMs,
+				f.stage, f.section, f.nodesGathered, f.nodesExcluded, f.objectsDrawn, f.immEntries, f.aftEntries,
+				f.sortMs, f.stageDrawMs);
+		}
+
+		const Summary summary = SummariseRun();
+		spdlog::info("Telemetry::DumpRun - {} frames to {}: avg {:.1f}FPS, 1% low {:.1f}FPS, p50 {:.2f}ms, p99 {:.2f}ms, max {:.2f}ms",
+			summary.frames, path.string(), summary.avgFps, summary.lowFps, summary.p50, summary.p99, summary.worst);
+
+		// Alongside the frames, keyed by the frame each press was presented on
+		if (!RunLatency.empty())
+		{
+			const auto latencyPath = folder / std::format("latency_{}.csv", stamp);
+			std::ofstream latencyFile(latencyPath, std::ios::out | std::ios::trunc);
+			if (!latencyFile.is_open())
+			{
+				spdlog::error("Telemetry::DumpRun - failed to open {} for writing", latencyPath.string());
+				return path;
+			}
+
+			latencyFile << "frame,config,total_ms,read_ms,tick_ms,present_ms\n";
+			for (const RunLatencySample& entry : RunLatency)
+			{
+				const LatencySample& sample = entry.sample;
+				latencyFile << std::format("{},{},{:.3f},{:.3f},{:.3f},{:.3f}\n", entry.frame, ConfigLabel(entry.config),
+					sample.totalMs, sample.readMs, sample.tickMs, sample.presentMs);
+			}
+
+			spdlog::info("Telemetry::DumpRun - {} input latency samples to {}", RunLatency.size(), latencyPath.string());
+		}
+
+		return path;
+	}
+}
+
+class FrameTelemetryWindow : public OverlayWindow
+{
+	// Sorting the history every frame would show up in the very numbers being
+	// taken, so the summary is only refreshed a few times a second.
+	Telemetry::Summary summary;
+	std::chrono::steady_clock::time_point lastSummary;
+
+	// Over the whole recorded run, worked out once recording stops.
+	Telemetry::Summary runSummary;
+
+	// One per latency group, and the current group's spread out to just past
+	// its p99, refreshed along with the frame summary.
+	std::vector<Telemetry::LatencySummary> latencySummaries;
+	std::array<float, 40> latencyHistogram{};
+	float latencyRange = 0.0f;
+
+	static void draw_summary_row(const char* label, const Telemetry::Summary& s)
+	{
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn(); ImGui::TextUnformatted(label);
+		ImGui::TableNextColumn(); ImGui::Text("%.1f", s.avgFps);
+		ImGui::TableNextColumn(); ImGui::Text("%.1f", s.lowFps);
+		ImGui::TableNextColumn(); ImGui::Text("%.2f", s.p1);
+		ImGui::TableNextColumn(); ImGui::Text("%.2f", s.p50);
+		ImGui::TableNextColumn(); ImGui::Text("%.2f", s.p99);
+		ImGui::TableNextColumn(); ImGui::Text("%.2f", s.worst);
+	}
+
+	void refresh_latency()
+	{
+		using namespace Telemetry;
+
+		latencySummaries.resize(Groups.size());
+		for (size_t i = 0; i < Groups.size(); i++)
+			latencySummaries[i] = SummariseLatency(Groups[i]);
+
+		latencyHistogram.fill(0.0f);
+		if (CurrentGroup < 0)
+			return;
+
+		const int bins = int(latencyHistogram.size());
+		latencyRange = max(latencySummaries[CurrentGroup].p99 * 1.25f, 1.0f);
+		for (const LatencySample& sample : Groups[CurrentGroup].samples)
+			latencyHistogram[std::clamp(int(sample.totalMs / latencyRange * bins), 0, bins - 1)] += 1.0f;
+	}
+
+	void draw_latency()
+	{
+		using namespace Telemetry;
+
+		// Presses still in flight would resolve against whatever Present
+		// comes once it's turned back on
+		if (ImGui::Checkbox("Measure input latency", &LatencyEnabled) && !LatencyEnabled)
+			PendingCount = 0;
+		if (!Settings::UseNewInput)
+		{
+			ImGui::SameLine();
+			ImGui::TextDisabled("(needs UseNewInput)");
+		}
+
+		if (!LatencyEnabled || Groups.empty())
+			return;
+
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+		{
+			Groups.clear();
+			PendingCount = 0;
+			latencySummaries.clear();
+			CurrentGroup = -1;
+			return;
+		}
+
+		if (ImGui::BeginTable("##latency", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+		{
+			ImGui::TableSetupColumn("Configuration");
+			ImGui::TableSetupColumn("Presses");
+			ImGui::TableSetupColumn("p50 ms");
+			ImGui::TableSetupColumn("p95 ms");
+			ImGui::TableSetupColumn("p99 ms");
+			ImGui::TableSetupColumn("Max ms");
+			ImGui::TableHeadersRow();
+
+			for (size_t i = 0; i < latencySummaries.size(); i++)
+			{
+				const LatencySummary& s = latencySummaries[i];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				if (int(i) == CurrentGroup)
+					ImGui::TextColored(ImVec4(0.4f, 0.8f, 0.4f, 1.f), "%s", ConfigLabel(Groups[i].config).c_str());
+				else
+					ImGui::TextUnformatted(ConfigLabel(Groups[i].config).c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%d", s.presses);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", s.p50);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", s.p95);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", s.p99);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", s.worst);
+			}
+
+			ImGui::EndTable();
+		}
+
+		if (CurrentGroup < 0 || CurrentGroup >= int(latencySummaries.size()))
+			return;
+
+		const LatencySummary& current = latencySummaries[CurrentGroup];
+		ImGui::Text("Current: press to read %.2fms, tick %.2fms, to present %.2fms (avg)",
+			current.readMs, current.tickMs, current.presentMs);
+
+		const std::string overlayText = std::format("0 - {:.1f}ms", latencyRange);
+		ImGui::PlotHistogram("##latencyhist", latencyHistogram.data(), int(latencyHistogram.size()), 0, overlayText.c_str(),
+			0.0f, FLT_MAX, ImVec2(ImGui::GetContentRegionAvail().x, 100.0f));
+	}
+
+public:
+	Kind kind() const override { return Kind::Tool; }
+	const char* name() const override { return "Frame Telemetry"; }
+
+	void init() override {}
+	void render(bool overlayEnabled) override
+	{
+		using namespace Telemetry;
+
+		ImGui::SetNextWindowSize(ImVec2(700, 420), ImGuiCond_FirstUseEver);
+		if (!ImGui::Begin("Frame Telemetry", &visible))
+		{
+			ImGui::End();
+			return;
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		if (now - lastSummary >= std::chrono::milliseconds(250))
+		{
+			summary = SummariseHistory();
+			if (LatencyEnabled)
+				refresh_latency();
+			lastSummary = now;
+		}
+
+		// Oldest first, so the graph scrolls right to left.
+		const int offset = HistoryCount < HistoryLength ? 0 : HistoryHead;
+		const float scaleMax = max(summary.p99 * 1.5f, 1000.0f / 30.0f);
+
+		const std::string overlayText = std::format("p50 {:.2f}ms / p99 {:.2f}ms", summary.p50, summary.p99);
+		ImGui::PlotLines("##frametimes", FrameTimes.data(), HistoryCount, offset, overlayText.c_str(),
+			0.0f, scaleMax, ImVec2(ImGui::GetContentRegionAvail().x, 160.0f));
+
+		if (ImGui::BeginTable("##summary", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchSame))
+		{
+			ImGui::TableSetupColumn("");
+			ImGui::TableSetupColumn("Avg FPS");
+			ImGui::TableSetupColumn("1% low FPS");
+			ImGui::TableSetupColumn("p1 ms");
+			ImGui::TableSetupColumn("p50 ms");
+			ImGui::TableSetupColumn("p99 ms");
+			ImGui::TableSetupColumn("Max ms");
+			ImGui::TableHeadersRow();
+
+			draw_summary_row("Recent", summary);
+			if (!Recording && runSummary.frames > 0)
+				draw_summary_row("Run", runSummary);
+
+			ImGui::EndTable();
+		}
+
+		ImGui::Separator();
+
+		if (!Recording)
+		{
+			if (ImGui::Button("Start recording"))
+			{
+				Run.clear();
+				Run.reserve(60 * 60 * 10);
+				RunLatency.clear();
+				runSummary = {};
+				Recording = true;
+			}
+		}
+		else if (ImGui::Button("Stop recording"))
+		{
+			Recording = false;
+			runSummary = SummariseRun();
+		}
+
+		ImGui::SameLine();
+		ImGui::BeginDisabled(Run.empty());
+		if (ImGui::Button("Dump CSV"))
+		{
+			const auto path = DumpRun();
+			if (!path.empty())
+				Notifications::instance.add(std::format("Frame telemetry saved to {}", path.filename().string()));
+		}
+		ImGui::EndDisabled();
+
+		ImGui::SameLine();
+		if (Recording)
+			ImGui::Text("Recording, %d frames", int(Run.size()));
+		else
+			ImGui::Text("%d frames captured", int(Run.size()));
+
+		ImGui::Separator();
+		draw_latency();
+
+		ImGui::End();
+	}
+
+	static FrameTelemetryWindow instance;
+};
+FrameTelemetryWindow FrameTelemetryWindow::instance;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// Per-frame timing capture, for benchmarking builds against each other. Fed
+// by ReplaceGameUpdateLoop once per rendered frame, shown by the "Frame
+// Telemetry" tool window, which can also dump a whole run to CSV.
+namespace Telemetry
+{
+	struct Frame
+	{
+		float frameMs = 0.0f;   // Present to Present
+		float sleepMs = 0.0f;   // limiter wait, including any file loading done in it
+		float tickMs = 0.0f;    // every game tick the frame ran
+		float interpMs = 0.0f;  // sprite replay and interpolation after the ticks
+		float drawMs = 0.0f;    // render path up to EndScene
+		float presentMs = 0.0f; // EndScene to Present returning, vsync wait included
+		int numUpdates = 0;
+
+		// Where the frame was rendered: stg_stage_num and the player car's
+		// OnRoadPlace_5C section, or -1 for either outside of gameplay.
+		int stage = -1;
+		int section = -1;
+
+		// Stage draw work, from RenderStats::Counters
+		int nodesGathered = 0;
+		int nodesExcluded = 0;
+		int objectsDrawn = 0;
+		int immEntries = 0;
+		int aftEntries = 0;
+		float sortMs = 0.0f;
+		float stageDrawMs = 0.0f;
+	};
+
+	void AddFrame(const Frame& frame);
+
+	// Input-to-photon latency, one sample per tick that handed the game a new
+	// press: from the press (when InputSamplingThread saw it, otherwise when
+	// the tick read it), through the end of that tick's ModeControl, to the
+	// Present that followed. Only gathered while enabled in the window, and
+	// only with UseNewInput, since InputManager is what spots the presses.
+	//
+	// Samples are grouped by the settings that move them, so configurations
+	// can be compared side by side within one session.
+	struct LatencyConfig
+	{
+		int limitMode = 0;
+		int limit = 0;
+		bool vsync = false;
+		bool interpolation = false;
+		bool lowLatency = false;
+		bool samplingThread = false;
+
+		bool operator==(const LatencyConfig&) const = default;
+	};
+
+	bool LatencyActive();
+
+	// QPC times. The tick the press was read on is the one that consumes it,
+	// the frame that tick ran for is the one that presents it.
+	void InputPressed(int64_t pressQpc, int64_t readQpc);
+	void TickConsumed(int64_t qpc);
+	void FramePresented(int64_t qpc, const LatencyConfig& config);
+}
@@ -2,6 +2,8 @@
 #include "plugin.hpp"
 #include "game_addrs.hpp"
 #include "input_manager.hpp"
+#include "bgm_cache.hpp"
+#include "sound_index.hpp"
 #include <mmiscapi.h>
 #include <fstream>
 #include <algorithm>
@@ -33,6 +35,8 @@ namespace Settings
 		"Where the track title is drawn on screen, based on games original 640x480 screen dimensions." };
 	Setting<bool> CDSwitcherShuffleTracks{ "CDSwitcher", "SwitcherShuffleTracks", false,
 		"Shuffles the tracks on game launch." };
+	Setting<bool> CDSwitcherPreload{ "CDSwitcher", "SwitcherPreload", true,
+		"Keeps the next and previous tracks cached in memory, so switching to them starts playing straight away." };
 }
 
 std::string BGMOverridePath;
@@ -50,54 +54,32 @@ class BGMLoaderHook : public Hook
 	inline static SafetyHookMid hook = {};
 	static void destination(safetyhook::Context& ctx)
 	{
-		std::filesystem::path strWaveFileName = *(const char**)(ctx.esp + 0x54);
+		const char* strWaveFileName = *(const char**)(ctx.esp + 0x54);
+
+		// Normally hardcoded to 3/OGG, but changing to 1/WAV allows using CWaveFile
+		// 2/FLAC is checked for by our hooks_flac.cpp code
+		const auto requested = BGMCache::FileType(ctx.eax);
+
+		// CD switcher tracks it has already cached skip the filesystem checks
+		BGMCache::Resolved resolved;
+		bool overridden = false;
 		if (!BGMOverridePath.empty())
 		{
-			if (!std::filesystem::exists(BGMOverridePath))
-				BGMOverridePath = ".\\Sound\\" + BGMOverridePath;
-
-			if (std::filesystem::exists(BGMOverridePath))
-			{
-				strcpy_s(CurWavFilePath, BGMOverridePath.c_str());
-				*(const char**)(ctx.esp + 0x54) = CurWavFilePath;
-				strWaveFileName = BGMOverridePath;
-			}
+			overridden = BGMCache::FindTrack(BGMOverridePath, resolved) ||
+				BGMCache::ResolveTrack(BGMOverridePath, requested, resolved);
 			BGMOverridePath.clear();
 		}
 
-		// If a .wav file exists with the same filename, let's try checking that file instead
-		std::filesystem::path fileNameAsWav = strWaveFileName;
-		fileNameAsWav = fileNameAsWav.replace_extension(".wav");
-		std::filesystem::path fileNameAsFlac = strWaveFileName;
-		fileNameAsFlac = fileNameAsFlac.replace_extension(".flac");
-
-		enum class WaveFileType
-		{
-			WAV = 1,
-			FLAC = 2,
-			OGG = 3
-		};
+		if (!overridden)
+			resolved = BGMCache::Resolve(strWaveFileName, requested);
 
-		// Normally hardcoded to 3/OGG, but changing to 1/WAV allows using CWaveFile
-		// 2/FLAC is checked for by our hooks_flac.cpp code
-		WaveFileType waveFileType = WaveFileType(ctx.eax);
-		if (Settings::AllowFLAC && std::filesystem::exists(fileNameAsFlac))
+		// Switch the file game is trying to load to the one we found
+		if (resolved.path != strWaveFileName)
 		{
-			waveFileType = WaveFileType::FLAC;
-
-			// Switch the file game is trying to load to the flac instead
-			strcpy_s(CurWavFilePath, fileNameAsFlac.string().c_str());
+			strcpy_s(CurWavFilePath, resolved.path.c_str());
 			*(const char**)(ctx.esp + 0x54) = CurWavFilePath;
 		}
-		else if (Settings::AllowWAV && std::filesystem::exists(fileNameAsWav))
-		{
-			waveFileType = WaveFileType::WAV;
-
-			// Switch the file game is trying to load to the wav instead
-			strcpy_s(CurWavFilePath, fileNameAsWav.string().c_str());
-			*(const char**)(ctx.esp + 0x54) = CurWavFilePath;
-		}
-		ctx.eax = int(waveFileType);
+		ctx.eax = int(resolved.type);
 	}
 
 public:
@@ -113,6 +95,9 @@ public:
 
 	bool apply() override
 	{
+		// Lets the loader check for alternatives without touching the disk
+		SoundIndex::AddDirectory(".\\Sound");
+
 		hook = safetyhook::create_mid(Module::exe_ptr(CSoundManager__CreateStreaming_HookAddr), destination);
 		return !!hook;
 	}
@@ -137,6 +122,19 @@ class CDSwitcher : public Hook
 	static constexpr uint32_t PadButtonCombo_Next = XINPUT_GAMEPAD_BACK;
 	static constexpr uint32_t PadButtonCombo_Prev = XINPUT_GAMEPAD_RIGHT_THUMB | XINPUT_GAMEPAD_BACK;
 
+	// Caches the tracks either side of the one just picked
+	static void prefetch_neighbours(int track)
+	{
+		if (!Settings::CDSwitcherPreload || Settings::CDTracks.size() < 2)
+			return;
+
+		const int count = int(Settings::CDTracks.size());
+		BGMCache::Prefetch({
+			Settings::CDTracks[(track + 1) % count].first,
+			Settings::CDTracks[(track + count - 1) % count].first
+		});
+	}
+
 	inline static SafetyHookInline Game_Ctrl = {};
 	static void destination()
 	{
@@ -192,6 +190,7 @@ class CDSwitcher : public Hook
 		{
 			BGMOverridePath = Settings::CDTracks[*Game::sel_bgm_kind_buf].first;
 			Game::adxPlay(0, 0, 0);
+			prefetch_neighbours(*Game::sel_bgm_kind_buf);
 
 			SongTitleDisplayTimer = SongTitleDisplayFrames;
 		}
@@ -210,6 +209,7 @@ class CDSwitcher : public Hook
 
 		BGMOverridePath = Settings::CDTracks[bgmIdx].first;
 		Game::adxPlay(0, 0, 0);
+		prefetch_neighbours(bgmIdx);
 	}
 
 public:
@@ -334,8 +334,14 @@ void CDSwitcher_ReadIni(const std::filesystem::path& iniPath)
 					iniTracks.emplace_back(path, name);
 					spdlog::info(" - CDTracks: Added track {} ({})", name, path);
 
+					// Index both folders the loader looks for the track in, so
+					// switching to it doesn't need to check the disk
+					const std::filesystem::path soundPath = ".\\Sound\\" + path;
+					SoundIndex::AddDirectory(std::filesystem::absolute(path).parent_path());
+					SoundIndex::AddDirectory(std::filesystem::absolute(soundPath).parent_path());
+
 					// Check both paths that the CDSwitcher code looks in
-					if (!std::filesystem::exists(path) && !std::filesystem::exists(".\\Sound\\" + path))
+					if (!SoundIndex::Exists(path) && !SoundIndex::Exists(soundPath))
 						spdlog::warn("^ File \"{}\" not found for track, likely won't play properly in-game!", path);
 				}
 			}
@@ -602,9 +602,16 @@ class FixFileLoadRace : public Hook
 	// anyone waiting.
 	inline static CRITICAL_SECTION ListLock{};
 
+	// Set each time the loader thread comes back round for another request,
+	// which it only does once the read it was making has finished. Lets the
+	// main thread sleep through a read it is waiting on instead of calling
+	// FileLoad_Ctrl over and over until the read lands.
+	inline static HANDLE LoaderProgressEvent = nullptr;
+
 	inline static SafetyHookMid ServiceRequest_hook = {};
 	static void ServiceRequest_dest(SafetyHookContext& ctx)
 	{
+		SetEvent(LoaderProgressEvent);
 		EnterCriticalSection(&ListLock);
 	}
 
@@ -684,6 +691,16 @@ class FixFileLoadRace : public Hook
 	}
 
 public:
+	// True if the loader moved on within the timeout, false on timeout or if
+	// the hook isn't in, in which case the caller is no worse off than before.
+	static bool WaitForLoader(DWORD timeoutMs)
+	{
+		if (!LoaderProgressEvent)
+			return false;
+
+		return WaitForSingleObject(LoaderProgressEvent, timeoutMs) == WAIT_OBJECT_0;
+	}
+
 	std::string_view description() override
 	{
 		return "FixFileLoadRace";
@@ -699,6 +716,7 @@ public:
 		// Held only across a list pop and push, so a waiter is better off spinning
 		// than paying for the trip into the kernel.
 		InitializeCriticalSectionAndSpinCount(&ListLock, 4000);
+		LoaderProgressEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
 
 		ServiceRequest_hook = safetyhook::create_mid(Module::exe_ptr(ServiceRequest_Addr), ServiceRequest_dest);
 		ServiceRequestMoveDone_hook = safetyhook::create_mid(Module::exe_ptr(ServiceRequestMoveDone_Addr), ServiceRequestMoveDone_dest);
@@ -713,6 +731,11 @@ public:
 };
 FixFileLoadRace FixFileLoadRace::instance;
 
+bool FileLoad_WaitForLoader(DWORD timeoutMs)
+{
+	return FixFileLoadRace::WaitForLoader(timeoutMs);
+}
+
 // LoadXmtsetObject builds an xmtset's objects in one state and its textures in
 // the next, each by calling a worker over and over until half a millisecond of
 // the frame has gone.
@@ -8,6 +8,11 @@
 #include <ini.h>
 #include "overlay/overlay.hpp"
 #include "input_manager.hpp"
+#include "lod_exclusions.hpp"
+#include "draw_sort.hpp"
+#include "frame_pacing.hpp"
+#include "render_stats.hpp"
+#include "worker_pool.hpp"
 
 namespace Settings
 {
@@ -17,11 +22,14 @@ namespace Settings
 	Setting<int> DrawDistanceBehind{ "Graphics", "DrawDistanceBehind", 0,
 		"Increases the distance models will draw behind the car, rather than them being culled out almost immediately. "
 		"A lot of models have backface culling issues, so only recommended if using freecam or other camera mods!", Range<int>{ 0, 1024 } };
+	Setting<int> DrawDistanceAdaptiveFPS{ "Graphics", "DrawDistanceAdaptiveFPS", 0,
+		"Framerate the draw distance should adapt to hold, 0 to always draw at DrawDistanceIncrease. "
+		"When set, DrawDistanceIncrease becomes the furthest it will draw, and the distance is pulled in on stages too heavy to hold the framerate at it.",
+		Range<int>{ 0, 360 } };
 }
 
 std::array<std::vector<uint16_t>, 256> ObjectNodes;
-std::array<std::array<std::bitset<16384>, 256>, 128> ObjectExclusionsPerStage;
-std::bitset<128> SkipQuickSortHackStages;
+LodExclusions ObjectExclusions;
 
 int NumObjects = 0;
 int CsLengthNum = 0;
@@ -30,6 +38,7 @@ bool DrawDistanceIncreaseEnabled = false;
 bool EnablePauseMenu = true;
 
 bool DrawDist_ReadExclusions();
+void DrawBuffers_FrameDone(int aftEntries, int aftUnkEntries);
 
 class DrawDistanceDebug : public OverlayWindow
 {
@@ -79,7 +88,6 @@ public:
 
 		GameStage cur_stage_num = *Game::stg_stage_num;
 		const char* cur_stage_name = Game::GetStageFriendlyName(cur_stage_num);
-		auto& objectExclusions = ObjectExclusionsPerStage[cur_stage_num];
 
 		ImGui::Text("Stage: %d (%s / %s)", cur_stage_num, cur_stage_name, Game::GetStageUniqueName(cur_stage_num));
 		ImGui::SliderInt("Draw Distance", Settings::DrawDistanceIncrease.ptr(), 0, 1024);
@@ -124,7 +132,7 @@ public:
 						for (int i = 0; i < ObjectNodes[objectIdx].size(); i++)
 						{
 							auto nodeId = ObjectNodes[objectIdx][i];
-							if (!objectExclusions[objectIdx][nodeId])
+							if (!ObjectExclusions.test(cur_stage_num, objectIdx, nodeId))
 							{
 								areAllExcluded = false;
 								break;
@@ -134,7 +142,7 @@ public:
 						for (int i = 0; i < ObjectNodes[objectIdx].size(); i++)
 						{
 							auto nodeId = ObjectNodes[objectIdx][i];
-							objectExclusions[objectIdx][nodeId] = areAllExcluded ? false : true;
+							ObjectExclusions.set(cur_stage_num, objectIdx, nodeId, !areAllExcluded);
 						}
 					}
 
@@ -144,10 +152,10 @@ public:
 							ImGui::PushID(i + 1);
 
 							auto nodeId = ObjectNodes[objectIdx][i];
-							bool excluded = objectExclusions[objectIdx][nodeId];
+							bool excluded = ObjectExclusions.test(cur_stage_num, objectIdx, nodeId);
 
 							if (ImGui::Checkbox("", &excluded))
-								objectExclusions[objectIdx][nodeId] = excluded;
+								ObjectExclusions.set(cur_stage_num, objectIdx, nodeId, excluded);
 
 							ImGui::SetItemTooltip("Stage %d, object 0x%X, node 0x%X", cur_stage_num, objectIdx, nodeId);
 
@@ -163,12 +171,16 @@ public:
 		if (ImGui::Button("Copy exclusions to clipboard"))
 		{
 			std::string clipboard = "";// 
-			for (int objId = 0; objId < objectExclusions.size(); objId++)
+			for (int objId = 0; objId < LodExclusions::MaxObjects; objId++)
 			{
+				auto* nodes = ObjectExclusions.find(cur_stage_num, objId);
+				if (!nodes)
+					continue;
+
 				std::string objLine = "";
-				for (int i = 0; i < objectExclusions[objId].size(); i++)
+				for (int i = 0; i < nodes->size(); i++)
 				{
-					if (objectExclusions[objId][i])
+					if ((*nodes)[i])
 					{
 						objLine += std::format(", 0x{:X}", i);
 					}
@@ -203,8 +215,7 @@ public:
 			}
 			else
 			{
-				for (int i = 0; i < objectExclusions.size(); i++)
-					objectExclusions[i].reset();
+				ObjectExclusions.clear_stage(cur_stage_num);
 				showReallyPrompt = false;
 			}
 		}
@@ -247,108 +258,238 @@ static int get_number(std::string_view sectionName)
 
 bool DrawDist_ReadExclusions()
 {
-	for (int x = 0; x < ObjectExclusionsPerStage.size(); x++)
-		for (int y = 0; y < ObjectExclusionsPerStage[x].size(); y++)
-			ObjectExclusionsPerStage[x][y].reset();
+	ObjectExclusions.clear();
 
 	// Try reading exclusions
 	std::filesystem::path& iniPath = Module::LodIniPath;
-	if (!std::filesystem::exists(iniPath))
+	LodExclusions::SourceStamp iniStamp;
+	if (!LodExclusions::stamp_of(iniPath, iniStamp))
 	{
 		spdlog::error("DrawDist_ReadExclusions - failed to locate exclusion INI from path {}", iniPath.string());
 		return false;
 	}
 
+	// The compiled copy is only used while it was built from this exact INI
+	const auto compiledPath = LodExclusions::compiled_path(iniPath);
+	LodExclusions::SourceStamp compiledStamp;
+	if (ObjectExclusions.read_compiled(compiledPath, compiledStamp) && compiledStamp == iniStamp)
+	{
+		spdlog::info("DrawDist_ReadExclusions - loaded compiled exclusions from {}", compiledPath.string());
+		return true;
+	}
+
 	spdlog::info("DrawDist_ReadExclusions - reading INI from {}", iniPath.string());
 
-	inih::INIReader ini;
-	try
+	std::vector<std::string> warnings;
+	if (!ObjectExclusions.read_ini(iniPath, warnings))
 	{
-		ini = inih::INIReader(iniPath);
+		spdlog::error("DrawDist_ReadExclusions - INI read failed!");
+		return false;
 	}
-	catch (...)
+
+	for (auto& warning : warnings)
+		spdlog::error("DrawDist_ReadExclusions - {}", warning);
+
+	if (ObjectExclusions.write_compiled(compiledPath, iniStamp))
+		spdlog::info("DrawDist_ReadExclusions - compiled exclusions to {}", compiledPath.string());
+	else
+		spdlog::warn("DrawDist_ReadExclusions - failed to write compiled exclusions to {}", compiledPath.string());
+
+	return true;
+}
+
+// Adaptive draw distance, for when DrawDistanceAdaptiveFPS is set.
+// DrawDistanceIncrease becomes the furthest it may draw, and the distance
+// actually used is pulled in while the frame's work runs over the target and
+// let back out while there's headroom. Between the two thresholds it holds,
+// so it doesn't hunt back and forth around the target.
+//
+// How far to move is worked out from what a section costs: stage draw time per
+// s_AftDrawBuffer entry, times the entries each section of the window adds.
+//
+// The distance each stage averaged over a race is kept in
+// OutRun2006Tweaks.drawdist.ini and used as its starting point next time, so a
+// heavy stage doesn't have to hitch its way back down every session.
+class AdaptiveDrawDistance
+{
+	// Fractions of the frame budget
+	static constexpr float ShrinkAbove = 0.90f;
+	static constexpr float GrowBelow = 0.70f;
+	static constexpr float Aim = 0.80f;
+
+	// Frames to hold after a change, so the work estimate has caught up with
+	// the new distance before the next is decided. Longer after a stage load,
+	// which runs a few heavy frames of its own.
+	static constexpr int SettleFrames = 15;
+	static constexpr int StageStartFrames = 60;
+
+	// Growing is limited to a couple of sections a frame, since it only ever
+	// chases headroom. Shrinking can take a quarter of the distance at once.
+	static constexpr float MaxGrowPerFrame = 2.0f;
+
+	inline static int Stage = -1;
+	inline static float Distance = 0.0f;
+	inline static int HoldFrames = 0;
+	inline static double DistanceSum = 0.0;
+	inline static int DistanceFrames = 0;
+
+	inline static FramePacing::Estimate MsPerEntry;
+	inline static FramePacing::Estimate EntriesPerSection;
+
+	inline static std::array<int, LodExclusions::MaxStages> Learned;
+
+	static void leave_stage()
 	{
-		spdlog::error("DrawDist_ReadExclusions - INI read failed! The file might not exist, or may have duplicate settings inside");
-		return false;
+		const double sum = DistanceSum;
+		const int frames = DistanceFrames;
+		DistanceSum = 0.0;
+		DistanceFrames = 0;
+
+		// Stages past the table still adapt, they just aren't remembered
+		if (Stage < 0 || Stage >= LodExclusions::MaxStages || frames <= 0)
+			return;
+
+		const int average = int(sum / frames + 0.5);
+
+		if (Learned[Stage] != average)
+		{
+			Learned[Stage] = average;
+			write();
+		}
 	}
 
-	for (auto& section : ini.Sections())
+public:
+	static bool read()
 	{
-		int stageNum = get_number(section);
-		if (stageNum >= ObjectExclusionsPerStage.size())
+		Learned.fill(-1);
+
+		if (!std::filesystem::exists(Module::DrawDistIniPath))
+			return true;
+
+		inih::INIReader ini;
+		try
+		{
+			ini = inih::INIReader(Module::DrawDistIniPath);
+		}
+		catch (...)
 		{
-			spdlog::error("DrawDist_ReadExclusions - INI contains invalid stage section \"{}\", skipping...", section);
-			continue;
+			spdlog::error("AdaptiveDrawDistance::read - INI read failed!");
+			return false;
 		}
-		SkipQuickSortHackStages[stageNum] = false;
 
-		for (auto& key : ini.Keys(section))
+		for (auto& section : ini.Sections())
 		{
-			if (key == "SkipQuickSort")
-			{
-				bool skip = false;
-				if (ini.Get<bool>(section, key, skip))
-					SkipQuickSortHackStages[stageNum] = true;
+			int stageNum = get_number(section);
+			if (stageNum < 0 || stageNum >= LodExclusions::MaxStages)
 				continue;
-			}
 
-			int objectId = -1;
-			try
-			{
-				objectId = std::stol(key, nullptr, 0);
-			}
-			catch (const std::invalid_argument& e)
-			{
-				continue;
-			}
-			catch (const std::out_of_range& e)
-			{
-				continue;
-			}
+			int distance = -1;
+			Learned[stageNum] = ini.Get<int>(section, "Distance", distance);
+		}
 
-			if (objectId < 0)
-				continue;
+		return true;
+	}
 
-			if (objectId >= ObjectExclusionsPerStage[stageNum].size())
-			{
-				spdlog::error("DrawDist_ReadExclusions - INI contains invalid object number \"{}\", skipping...", key);
-				continue;
-			}
+	static bool write()
+	{
+		inih::INIReader ini;
+		for (int stage = 0; stage < LodExclusions::MaxStages; stage++)
+			if (Learned[stage] >= 0)
+				ini.Set(std::format("Stage {}", stage), "Distance", Learned[stage]);
 
-			std::vector<int> nodes;
+		inih::INIWriter writer;
+		try
+		{
+			writer.write(Module::DrawDistIniPath, ini);
+		}
+		catch (...)
+		{
+			spdlog::error("AdaptiveDrawDistance::write - INI write failed!");
+			return false;
+		}
+		return true;
+	}
 
-			auto value = ini.Get(section, key);
-			std::istringstream stream(value);
-			std::string token;
+	// Saves what the current stage averaged, and has the next race start
+	// again from that. Called when a race ends and at shutdown.
+	static void finish()
+	{
+		leave_stage();
+		Stage = -1;
+	}
 
-			// Tokenize the string using ',' as the delimiter
-			while (std::getline(stream, token, ','))
-			{
-				// Remove leading/trailing whitespace
-				token.erase(0, token.find_first_not_of(" \t"));
-				token.erase(token.find_last_not_of(" \t") + 1);
+	// Called once per frame from DispStage with the previous frame's stage
+	// draw cost, returns the distance to draw this frame at.
+	static int update(int stage, int maxDistance, float stageDrawMs, int aftEntries, int sections)
+	{
+		auto& stats = RenderStats::Stats;
 
-				// Convert the token to an integer
-				try
-				{
-					nodes.push_back(std::stol(token, nullptr, 0));
-				}
-				catch (const std::invalid_argument& e)
-				{
-				}
-				catch (const std::out_of_range& e)
-				{
-				}
-			}
+		if (stage != Stage)
+		{
+			leave_stage();
+			Stage = stage;
 
-			for (auto& node : nodes)
-			{
-				ObjectExclusionsPerStage[stageNum][objectId][node] = true;
-			}
+			const int learned = (stage >= 0 && stage < LodExclusions::MaxStages) ? Learned[stage] : -1;
+			Distance = float(learned >= 0 ? min(learned, maxDistance) : maxDistance);
+			HoldFrames = StageStartFrames;
 		}
+
+		if (aftEntries > 0 && sections > 0)
+		{
+			MsPerEntry.add(stageDrawMs / aftEntries);
+			EntriesPerSection.add(float(aftEntries) / sections);
+		}
+
+		const float budgetMs = 1000.0f / Settings::DrawDistanceAdaptiveFPS;
+		const float workMs = FramePacing::Stats.frameWork.meanMs;
+		const float msPerSection = max(MsPerEntry.meanMs * EntriesPerSection.meanMs, 0.001f);
+
+		if (HoldFrames > 0)
+		{
+			HoldFrames--;
+		}
+		else if (workMs > budgetMs * ShrinkAbove)
+		{
+			const float over = (workMs - budgetMs * Aim) / msPerSection;
+			Distance -= std::clamp(over, 1.0f, Distance * 0.25f + 1.0f);
+			HoldFrames = SettleFrames;
+		}
+		else if (workMs < budgetMs * GrowBelow)
+		{
+			const float headroom = (budgetMs * Aim - workMs) / msPerSection;
+			Distance += std::clamp(headroom, 0.0f, MaxGrowPerFrame);
+		}
+
+		Distance = std::clamp(Distance, 0.0f, float(maxDistance));
+		DistanceSum += Distance;
+		DistanceFrames++;
+
+		stats.adaptiveActive = true;
+		stats.adaptiveDistance = int(Distance);
+		stats.adaptiveMaxDistance = maxDistance;
+		stats.adaptiveBudgetMs = budgetMs;
+		stats.adaptiveWorkMs = workMs;
+		stats.adaptiveMsPerSection = msPerSection;
+
+		return int(Distance);
 	}
+};
 
-	return true;
+// Once per frame from the game loop, so a race ending is seen even though
+// DispStage stops being called
+void DrawDist_Update()
+{
+	static bool wasInGame = false;
+
+	const bool inGame = Game::is_in_game();
+	if (wasInGame && !inGame)
+		AdaptiveDrawDistance::finish();
+	wasInGame = inGame;
+}
+
+void DrawDist_Shutdown()
+{
+	AdaptiveDrawDistance::finish();
 }
 
 // Orders the stage draw list on each entries bounding sphere far edge. View
@@ -379,38 +520,130 @@ class StableDrawSort : public Hook
 		return entry->CenterZ_0 - radius;
 	}
 
+	inline static double QpcPerMs = 0;
+
+	// Sized to the largest list seen, kept between frames
+	inline static std::vector<DrawSort::Item> Items;
+	inline static std::vector<DrawSort::Item> Scratch;
+
+	// Previous frame's result as indices into Buffer_14. The stage queues much
+	// the same nodes in the same order each frame, so entry n tends to be the
+	// same model at much the same depth, and last frame's order is nearly this
+	// frame's.
+	inline static std::vector<uint16_t> PrevOrder;
+
 	static void SortDrawBuffer(DrawBuffer* buffer)
 	{
+		auto& stats = RenderStats::Stats;
+
 		DrawEntry** entries = buffer->BufferPtrs_10;
+		const int count = buffer->NumBuffers_0;
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+
+		if (int(Items.size()) < count)
+		{
+			Items.resize(count);
+			Scratch.resize(count);
+		}
+
+		// Both faster paths lean on the list being Buffer_14 in queue order, as
+		// the game always builds it: the radix sort to keep the tie-break, and
+		// the coherent one to find last frame's entries by index. Anything
+		// else, and the debug comparison, goes through the comparison sort.
+		bool queuedInOrder = count <= 0xFFFF;
+		for (int i = 0; i < count && queuedInOrder; i++)
+			queuedInOrder = entries[i] == &buffer->Buffer_14[i];
 
-		std::sort(entries, entries + buffer->NumBuffers_0,
-			[](const DrawEntry* a, const DrawEntry* b)
+		if (stats.sortReference || !queuedInOrder)
+		{
+			std::sort(entries, entries + count,
+				[](const DrawEntry* a, const DrawEntry* b)
+				{
+					const float ka = SortKey(a);
+					const float kb = SortKey(b);
+
+					if (ka < kb)
+						return true;
+					if (kb < ka)
+						return false;
+
+					return a < b;
+				});
+
+			PrevOrder.clear();
+			stats.sortPath = 0;
+		}
+		else
+		{
+			// In queue order, an entry's index is its pointer order, so the
+			// index tie-break matches the comparison sort's
+			bool coherent = int(PrevOrder.size()) == count;
+			if (coherent)
 			{
-				const float ka = SortKey(a);
-				const float kb = SortKey(b);
+				for (int i = 0; i < count; i++)
+					Items[i] = { DrawSort::SortableKey(SortKey(entries[PrevOrder[i]])), PrevOrder[i] };
+				coherent = DrawSort::SortCoherent(Items.data(), count);
+			}
 
-				if (ka < kb)
-					return true;
-				if (kb < ka)
-					return false;
+			if (coherent)
+			{
+				stats.sortPath = 1;
+				stats.sortCoherentFrames++;
+			}
+			else
+			{
+				for (int i = 0; i < count; i++)
+					Items[i] = { DrawSort::SortableKey(SortKey(entries[i])), uint32_t(i) };
+
+				DrawSort::SortRadix(Items.data(), Scratch.data(), count);
+				stats.sortPath = 2;
+				stats.sortRadixFrames++;
+			}
 
-				// BufferPtrs_10[n] is set to &Buffer_14[n] as entries are appended,
-				// so pointer order is the order the stage queued them.
-				return a < b;
-			});
+			PrevOrder.resize(count);
+			for (int i = 0; i < count; i++)
+			{
+				entries[i] = &buffer->Buffer_14[Items[i].index];
+				PrevOrder[i] = uint16_t(Items[i].index);
+			}
+		}
+
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+
+		const float sortMs = float(double(end.QuadPart - start.QuadPart) / QpcPerMs);
+		stats.sortCost.add(sortMs);
+		stats.sortEntries = count;
+		stats.frame.sortMs += sortMs;
 	}
 
 	inline static SafetyHookInline DrawStoredModel_Execute_hook = {};
 	static void DrawStoredModel_Execute_dest()
 	{
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+
+		const int aftEntries = Game::s_AftDrawBuffer->NumBuffers_0;
+		const int aftUnkEntries = Game::s_AftDrawBuffer->field_8;
+		RenderStats::Stats.frame.aftEntries += aftEntries;
+
 		// TODO: Allow excluding stages if our new sort causes issues with them.
-		// (or remove SkipQuickSortHackStages entirely if all work fine)
-		//if (!SkipQuickSortHackStages[*Game::stg_stage_num])
+		// (or remove SkipQuickSort from the exclusions INI entirely if all work fine)
+		//if (!ObjectExclusions.skip_quick_sort(*Game::stg_stage_num))
 		SortDrawBuffer(Game::s_AftDrawBuffer);
 
 		Game::DrawStoredModel_Internal(Game::s_AftDrawBuffer);
+
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+		RenderStats::Stats.frame.stageDrawMs += float(double(end.QuadPart - start.QuadPart) / QpcPerMs);
+
 		Game::s_AftDrawBuffer->NumBuffers_0 = 0;
 		Game::s_AftDrawBuffer->field_8 = 0;
+
+		DrawBuffers_FrameDone(aftEntries, aftUnkEntries);
 	}
 
 public:
@@ -423,6 +656,10 @@ public:
 	{
 		constexpr int DrawStoredModel_Execute_Addr = 0x5830;
 
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		QpcPerMs = double(frequency.QuadPart) / 1000.0;
+
 		// This func has some weird securom protection bytes inside, we'll nop the beginning so safetyhook doesn't get confused
 		Memory::VP::Nop(Module::exe_ptr(DrawStoredModel_Execute_Addr), 5);
 		DrawStoredModel_Execute_hook = safetyhook::create_inline(Module::exe_ptr(DrawStoredModel_Execute_Addr), DrawStoredModel_Execute_dest);
@@ -469,8 +706,176 @@ class DrawDistanceIncrease : public Hook
 	inline static uint16_t CollisionNodeIdxArray[4096];
 	inline static std::array<uint8_t, 4096> CollisionNodesToDisplay;
 
-	inline static SafetyHookMid dest_hook = {};
-	static void destination(safetyhook::Context& ctx)
+	// Incremental version of the gather, used whenever the debug window is
+	// closed. The car only moves a section or so per frame, so rather than
+	// walking every section in range for every object, each object counts
+	// how many sections in the window list each node and patches its output
+	// as sections enter and leave.
+	//
+	// The output order differs from the full walk, which doesn't matter since
+	// the stage draw list is depth sorted afterwards.
+	static constexpr uint16_t NotListed = 0xFFFF;
+
+	//
+	// The per-node arrays only reach as far as the highest node the object's
+	// sections have listed. Most objects use a few hundred of the 4096, and a
+	// stage can have a couple of hundred objects.
+	struct ObjectWindow
+	{
+		std::vector<uint16_t> refCount; // sections in the window listing each node
+		std::vector<uint16_t> listPos;  // index into nodes, or NotListed
+		std::vector<uint8_t> inCurrent; // listed by the car's own section
+		std::vector<uint16_t> nodes;    // what gets drawn
+
+		int present = 0; // nodes with a non-zero count, listed or excluded
+
+		const LodExclusions::NodeSet* exclusions = nullptr;
+		bool currentIgnoresExclusions = false;
+
+		// Keeps the capacity, so rebuilding within a stage doesn't reallocate
+		void reset(const LodExclusions::NodeSet* objectExclusions, bool ignoreForCurrent)
+		{
+			refCount.clear();
+			listPos.clear();
+			inCurrent.clear();
+			nodes.clear();
+			present = 0;
+
+			exclusions = objectExclusions;
+			currentIgnoresExclusions = ignoreForCurrent;
+		}
+
+		// Grows the per-node arrays to take node, in steps of 64 so a section
+		// listing its nodes in rising order doesn't resize for each one.
+		bool cover(uint16_t node)
+		{
+			if (node < refCount.size())
+				return true;
+			if (node >= CollisionNodesToDisplay.size())
+				return false;
+
+			const size_t size = min((size_t(node) + 64) & ~size_t(63), CollisionNodesToDisplay.size());
+			refCount.resize(size, 0);
+			listPos.resize(size, NotListed);
+			inCurrent.resize(size, 0);
+			return true;
+		}
+
+		// Brings the node's place in the output list in line with its counts.
+		void update(uint16_t node)
+		{
+			// (if it's in the current section exclusions are ignored, since this is what vanilla game would display)
+			const bool wanted = refCount[node] > 0 &&
+				((currentIgnoresExclusions && inCurrent[node]) || !exclusions || !(*exclusions)[node]);
+			const bool listed = listPos[node] != NotListed;
+			if (wanted == listed)
+				return;
+
+			if (wanted)
+			{
+				listPos[node] = uint16_t(nodes.size());
+				nodes.push_back(node);
+			}
+			else
+			{
+				const uint16_t pos = listPos[node];
+				const uint16_t last = nodes.back();
+				nodes[pos] = last;
+				listPos[last] = pos;
+				nodes.pop_back();
+				listPos[node] = NotListed;
+			}
+		}
+
+		void add_section(const uint16_t* list)
+		{
+			for (; *list != 0xFFFF; list++)
+				if (cover(*list) && ++refCount[*list] == 1)
+				{
+					present++;
+					update(*list);
+				}
+		}
+
+		void remove_section(const uint16_t* list)
+		{
+			for (; *list != 0xFFFF; list++)
+				if (*list < refCount.size() && refCount[*list] > 0 && --refCount[*list] == 0)
+				{
+					present--;
+					update(*list);
+				}
+		}
+
+		void set_current(const uint16_t* list, bool current)
+		{
+			for (; *list != 0xFFFF; list++)
+				if (cover(*list))
+				{
+					inCurrent[*list] = current;
+					update(*list);
+				}
+		}
+	};
+
+	// Everything the windows were built against. If any of it other than the
+	// section range changes they're rebuilt from scratch.
+	struct WindowCache
+	{
+		bool valid = false;
+		int sectionData = 0;
+		int stage = -1;
+		int csMaxLength = 0;
+		uint32_t exclusionsGeneration = 0;
+		bool currentIgnoresExclusions = false;
+
+		int first = 0;
+		int last = -1;
+		int current = 0;
+
+		std::vector<ObjectWindow> objects;
+	};
+	inline static WindowCache Windows;
+
+	static const uint16_t* section_nodes(int sectionData, uint32_t objectOffset, int section)
+	{
+		uint32_t sectionCollListOffset = *(uint32_t*)(sectionData + objectOffset + (section * 4));
+		return (const uint16_t*)(sectionData + objectOffset + sectionCollListOffset);
+	}
+
+	static void update_window(ObjectWindow& window, int sectionData, uint32_t objectOffset, bool rebuild, int first, int last, int current)
+	{
+		auto add = [&](int from, int to) {
+			for (int section = from; section <= to; section++)
+				window.add_section(section_nodes(sectionData, objectOffset, section));
+		};
+		auto remove = [&](int from, int to) {
+			for (int section = from; section <= to; section++)
+				window.remove_section(section_nodes(sectionData, objectOffset, section));
+		};
+
+		if (rebuild)
+		{
+			add(first, last);
+		}
+		else
+		{
+			// Add before removing, so nodes shared by the sections entering and
+			// leaving stay where they are in the list
+			add(first, Windows.first - 1);
+			add(Windows.last + 1, last);
+			remove(Windows.first, first - 1);
+			remove(last + 1, Windows.last);
+
+			if (current != Windows.current)
+				window.set_current(section_nodes(sectionData, objectOffset, Windows.current), false);
+		}
+
+		if (rebuild || current != Windows.current)
+			window.set_current(section_nodes(sectionData, objectOffset, current), true);
+	}
+
+	static void gather_and_draw(safetyhook::Context& ctx, int maxDrawDistance)
 	{
 		int xmtSetShifted = *(int*)(ctx.esp + 0x14); // XMTSET num shifted left by 16
 		uint8_t* a2 = *(uint8_t**)(ctx.esp + 0x24);
@@ -478,28 +883,112 @@ class DrawDistanceIncrease : public Hook
 		int a5 = ctx.edx;
 
 		int CsMaxLength = Game::GetMaxCsLen(0);
-		CsLengthNum = ctx.ebp;
 
 		int v6 = ctx.ebx;
 		uint32_t* v11 = (uint32_t*)(v6 + 8);
 
-		auto& objectExclusions = ObjectExclusionsPerStage[*Game::stg_stage_num];
+		const int stageNum = *Game::stg_stage_num;
 
-		int maxDrawDistance = Settings::DrawDistanceIncrease;
+		NumObjects = *(int*)(ctx.esp + 0x18);
 
-		// Per-stage overrides
-		if (!DrawDistanceDebug::instance.visible)
+		auto& stats = RenderStats::Stats;
+		stats.sectionsDrawn = max(min(CsLengthNum + maxDrawDistance, CsMaxLength - 2) - max(CsLengthNum - Settings::DrawDistanceBehind, 0) + 1, 1);
+
+		// The debug window needs the nodes of the furthest section on their own,
+		// which only the full walk below gathers
+		if (!DrawDistanceDebug::instance.visible && CsLengthNum >= 0 && CsLengthNum < (CsMaxLength - 1))
 		{
-			// CANYON: when cur section is lower than 30 (car inside bunki), limit draw dist to ~80
-			// prevents some far-off stage parts drawing in the air
-			if (*Game::stg_stage_num == STAGE_GRAND_CANYON && CsLengthNum < 30)
-				maxDrawDistance = min(maxDrawDistance, 80);
+			const int first = max(CsLengthNum - Settings::DrawDistanceBehind, 0);
+			const int last = min(CsLengthNum + maxDrawDistance, CsMaxLength - 2);
+			const bool currentIgnoresExclusions = Settings::DrawDistanceIncrease > 0;
+
+			// Sliding costs a walk of every section entering or leaving, so past
+			// the size of the new window a rebuild is cheaper
+			const int changed = abs(first - Windows.first) + abs(last - Windows.last);
+
+			const bool rebuild = !Windows.valid ||
+				Windows.sectionData != v6 ||
+				Windows.stage != stageNum ||
+				Windows.csMaxLength != CsMaxLength ||
+				Windows.exclusionsGeneration != ObjectExclusions.generation() ||
+				Windows.currentIgnoresExclusions != currentIgnoresExclusions ||
+				int(Windows.objects.size()) != NumObjects ||
+				first > Windows.last || last < Windows.first ||
+				changed > (last - first + 1);
+
+			// A new stage starts the windows over, so arrays sized for the last
+			// stage's nodes are let go rather than carried along
+			if (Windows.stage != stageNum || Windows.sectionData != v6)
+				Windows.objects.clear();
+			if (rebuild)
+				Windows.objects.resize(NumObjects);
+
+			LARGE_INTEGER gatherStart;
+			QueryPerformanceCounter(&gatherStart);
+
+			// Gathering only reads the section lists and writes the object's
+			// own window, so objects can be split across threads. Submission
+			// below stays in order on this one.
+			auto gather = [&](int ObjectNum)
+			{
+				ObjectWindow& window = Windows.objects[ObjectNum];
+				if (rebuild)
+					window.reset(ObjectExclusions.find(stageNum, ObjectNum), currentIgnoresExclusions);
+
+				update_window(window, v6, v11[ObjectNum], rebuild, first, last, CsLengthNum);
+			};
+
+			const int sectionsWalked = rebuild ? (last - first + 1) : (changed + (CsLengthNum != Windows.current ? 2 : 0));
+			const bool parallel = GatherPool && sectionsWalked * NumObjects >= ParallelMinSections;
+			if (parallel)
+				GatherPool->run(NumObjects, gather);
+			else
+				for (int ObjectNum = 0; ObjectNum < NumObjects; ObjectNum++)
+					gather(ObjectNum);
+
+			LARGE_INTEGER gatherEnd;
+			QueryPerformanceCounter(&gatherEnd);
+
+			stats.gatherMs = float(double(gatherEnd.QuadPart - gatherStart.QuadPart) / QpcPerMs);
+			stats.gatherSectionsWalked = sectionsWalked * NumObjects;
+			stats.gatherParallel = parallel;
+			if (stats.gatherMs > stats.gatherPeakMs)
+				stats.gatherPeakMs = stats.gatherMs;
+
+			for (int ObjectNum = 0; ObjectNum < NumObjects; ObjectNum++)
+			{
+				ObjectWindow& window = Windows.objects[ObjectNum];
+
+				const size_t count = min(window.nodes.size(), std::size(CollisionNodeIdxArray) - 1);
+				stats.frame.nodesGathered += int(count);
+				stats.frame.nodesExcluded += window.present - int(window.nodes.size());
+				if (count)
+					stats.frame.objectsDrawn++;
+
+				memcpy(CollisionNodeIdxArray, window.nodes.data(), count * sizeof(uint16_t));
+				CollisionNodeIdxArray[count] = 0xFFFF;
+
+				Game::DrawObject_Internal(xmtSetShifted | ObjectNum, 0, CollisionNodeIdxArray, a4, a5, 0);
+			}
+
+			Windows.valid = true;
+			Windows.sectionData = v6;
+			Windows.stage = stageNum;
+			Windows.csMaxLength = CsMaxLength;
+			Windows.exclusionsGeneration = ObjectExclusions.generation();
+			Windows.currentIgnoresExclusions = currentIgnoresExclusions;
+			Windows.first = first;
+			Windows.last = last;
+			Windows.current = CsLengthNum;
+			return;
 		}
 
-		NumObjects = *(int*)(ctx.esp + 0x18);
+		// The full walk leaves the windows alone, they still match the range
+		// they were last updated to and carry on from there once it's closed.
 		for (int ObjectNum = 0; ObjectNum < NumObjects; ObjectNum++)
 		{
 			memset(CollisionNodesToDisplay.data(), 0, CollisionNodesToDisplay.size());
+			const LodExclusions::NodeSet* objectExclusions = ObjectExclusions.find(stageNum, ObjectNum);
 			uint16_t* cur = CollisionNodeIdxArray;
 
 			for (int csOffset = -Settings::DrawDistanceBehind; csOffset < (maxDrawDistance + 1); csOffset++)
@@ -534,11 +1023,13 @@ class DrawDistanceIncrease : public Hook
 
 						// DEBUG: check exclusions here before adding to *cur
 						// (if we're at csOffset = 0 exclusions are ignored, since this is what vanilla game would display)
-						if ((csOffset == 0 && Settings::DrawDistanceIncrease > 0) || !objectExclusions[ObjectNum][*sectionCollList])
+						if ((csOffset == 0 && Settings::DrawDistanceIncrease > 0) || !objectExclusions || !(*objectExclusions)[*sectionCollList])
 						{
 							*cur = *sectionCollList;
 							cur++;
 						}
+						else
+							stats.frame.nodesExcluded++;
 
 						// DEBUG: add *sectionCollList to lastadds list here
 						if (DrawDistanceDebug::instance.visible && csOffset == maxDrawDistance)
@@ -553,12 +1044,58 @@ class DrawDistanceIncrease : public Hook
 
 			*cur = 0xFFFF;
 
+			const int count = int(cur - CollisionNodeIdxArray);
+			stats.frame.nodesGathered += count;
+			if (count)
+				stats.frame.objectsDrawn++;
+
 			Game::DrawObject_Internal(xmtSetShifted | ObjectNum, 0, CollisionNodeIdxArray, a4, a5, 0);
 
 			v11++;
 		}
 	}
 
+	inline static double QpcPerMs = 0;
+
+	// Below this many section lists walked across all objects, waking the
+	// pool costs more than it saves. A frame that only slides the window by
+	// a section or two never gets near it, a rebuild at a long distance does.
+	static constexpr int ParallelMinSections = 2048;
+	inline static WorkerPool* GatherPool = nullptr;
+
+	inline static SafetyHookMid dest_hook = {};
+	static void destination(safetyhook::Context& ctx)
+	{
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+
+		auto& stats = RenderStats::Stats;
+
+		CsLengthNum = ctx.ebp;
+
+		int maxDrawDistance = Settings::DrawDistanceIncrease;
+		stats.adaptiveActive = false;
+
+		// Per-stage overrides
+		if (!DrawDistanceDebug::instance.visible)
+		{
+			if (Settings::DrawDistanceAdaptiveFPS > 0)
+				maxDrawDistance = AdaptiveDrawDistance::update(*Game::stg_stage_num, maxDrawDistance,
+					stats.last.stageDrawMs, stats.last.aftEntries, stats.sectionsDrawn);
+
+			// CANYON: when cur section is lower than 30 (car inside bunki), limit draw dist to ~80
+			// prevents some far-off stage parts drawing in the air
+			if (*Game::stg_stage_num == STAGE_GRAND_CANYON && CsLengthNum < 30)
+				maxDrawDistance = min(maxDrawDistance, 80);
+		}
+
+		gather_and_draw(ctx, maxDrawDistance);
+
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+		stats.frame.stageDrawMs += float(double(end.QuadPart - start.QuadPart) / QpcPerMs);
+	}
+
 public:
 	std::string_view description() override
 	{
@@ -589,7 +1126,17 @@ public:
 
 		DrawDistanceIncreaseEnabled = true;
 
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		QpcPerMs = double(frequency.QuadPart) / 1000.0;
+
 		DrawDist_ReadExclusions();
+		AdaptiveDrawDistance::read();
+
+		// Leave a core for the game's own loader and audio threads
+		const int workers = min(int(std::thread::hardware_concurrency()) - 2, 3);
+		if (workers > 0)
+			GatherPool = new WorkerPool(workers);
 
 		return true;
 	}
@@ -600,30 +1147,120 @@ DrawDistanceIncrease DrawDistanceIncrease::instance;
 
 class DrawBufferExtension : public Hook
 {
+	constexpr static int s_ImmDrawBufferSizeVanilla = 0x100;
+	constexpr static int s_AftDrawBufferSizeVanilla = 0x600;
+
+	// Growing stops here, since StableDrawSort indexes entries with 16 bits
+	constexpr static int MaxBufferSize = 0x10000;
+
+	constexpr static int UnkEntrySize = 0x40; // todo: what 0x40 byte struct is this?
+
+	// The three parallel arrays of a buffer share one allocation, so growing it
+	// is a single malloc and free. Only ever swapped while the buffer is empty,
+	// so nothing needs copying across.
+	struct Arena
+	{
+		void* memory = nullptr;
+		int capacity = 0;
+		bool growPending = false;
+	};
+	inline static Arena ImmArena;
+	inline static Arena AftArena;
+
+	static bool allocate(DrawBuffer* buffer, Arena& arena, int capacity)
+	{
+		auto align = [](size_t size) { return (size + 15) & ~size_t(15); };
+
+		const size_t bufferPtrsSize = align(capacity * sizeof(DrawEntry*));
+		const size_t buffersSize = align(capacity * sizeof(DrawEntry));
+		const size_t unkbuffersSize = capacity * UnkEntrySize;
+
+		uint8_t* memory = (uint8_t*)malloc(bufferPtrsSize + buffersSize + unkbuffersSize);
+		if (!memory)
+		{
+			spdlog::error("DrawBufferExtension::allocate - failed to allocate {} entries", capacity);
+			return false;
+		}
+
+		buffer->MaxBuffers_4 = capacity;
+		buffer->MaxBuffers_C = capacity;
+
+		buffer->BufferPtrs_10 = (DrawEntry**)memory;
+		buffer->Buffer_14 = (DrawEntry*)(memory + bufferPtrsSize);
+		buffer->UnkBuffer_18 = memory + bufferPtrsSize + buffersSize;
+
+		free(arena.memory);
+		arena.memory = memory;
+		arena.capacity = capacity;
+		arena.growPending = false;
+		return true;
+	}
+
+	// Counts a frame's use of a buffer, and marks it to grow once the frame
+	// gets within an eighth of its capacity. field_8 seems to count the
+	// UnkBuffer_18 entries, it's reset alongside NumBuffers_0, so whichever
+	// ran higher is what counts.
+	static void track(RenderStats::BufferUsage& usage, Arena& arena, int entries, int unkEntries, int capacity)
+	{
+		const int used = max(entries, unkEntries);
+
+		usage.capacity = capacity;
+		usage.lastFrame = used;
+		usage.peak = max(usage.peak, used);
+		if (used >= capacity)
+			usage.saturatedFrames++;
+
+		if (arena.memory && used >= capacity - capacity / 8 && arena.capacity < MaxBufferSize)
+			arena.growPending = true;
+	}
+
+	static void grow(DrawBuffer* buffer, Arena& arena, RenderStats::BufferUsage& usage, const char* name)
+	{
+		const int capacity = min(arena.capacity * 2, MaxBufferSize);
+		if (allocate(buffer, arena, capacity))
+		{
+			usage.grows++;
+			spdlog::info("DrawBufferExtension: grew {} to {} entries", name, capacity);
+		}
+	}
+
 	inline static SafetyHookInline drawbufferinit_hook = {};
 	static void drawbufferinit_dest()
 	{
 		drawbufferinit_hook.call();
 
-		auto resize_buffer = [](DrawBuffer* buffer, int max_size)
-		{
-			int bufferPtrsSize_Imm = max_size * sizeof(DrawEntry*);
-			int buffersSize_Imm = max_size * sizeof(DrawEntry);
-			int unkbuffersSize_Imm = max_size * 0x40; // todo: what 0x40 byte struct is this?
+		allocate(Game::s_ImmDrawBuffer, ImmArena, s_ImmDrawBufferSizeVanilla * 0x10);
+		allocate(Game::s_AftDrawBuffer, AftArena, s_AftDrawBufferSizeVanilla * 2);
+	}
+
+public:
+	// Called once a frame, from DrawStoredModel_Execute after it empties
+	// s_AftDrawBuffer. The immediate buffer is drained on its own schedule, so
+	// it can only be sampled, and only grown when it happens to be empty.
+	static void frame_done(int aftEntries, int aftUnkEntries)
+	{
+		auto& stats = RenderStats::Stats;
 
-			buffer->MaxBuffers_4 = max_size;
-			buffer->MaxBuffers_C = max_size;
+		DrawBuffer* imm = Game::s_ImmDrawBuffer;
+		DrawBuffer* aft = Game::s_AftDrawBuffer;
 
-			buffer->BufferPtrs_10 = (DrawEntry**)malloc(bufferPtrsSize_Imm);
-			buffer->Buffer_14 = (DrawEntry*)malloc(buffersSize_Imm);
-			buffer->UnkBuffer_18 = malloc(unkbuffersSize_Imm);
-		};
+		track(stats.immBuffer, ImmArena, imm->NumBuffers_0, imm->field_8, imm->MaxBuffers_4);
+		stats.frame.immEntries = max(stats.frame.immEntries, imm->NumBuffers_0);
+		track(stats.aftBuffer, AftArena, aftEntries, aftUnkEntries, aft->MaxBuffers_4);
+
+		const int stage = *Game::stg_stage_num;
+		if (stage >= 0 && stage < int(stats.stagePeaks.size()))
+		{
+			auto& peaks = stats.stagePeaks[stage];
+			peaks.imm = max(peaks.imm, stats.immBuffer.lastFrame);
+			peaks.aft = max(peaks.aft, stats.aftBuffer.lastFrame);
+		}
 
-		constexpr int s_ImmDrawBufferSizeVanilla = 0x100;
-		constexpr int s_AftDrawBufferSizeVanilla = 0x600;
+		if (AftArena.growPending)
+			grow(aft, AftArena, stats.aftBuffer, "s_AftDrawBuffer");
 
-		resize_buffer(Game::s_ImmDrawBuffer, s_ImmDrawBufferSizeVanilla * 0x10);
-		resize_buffer(Game::s_AftDrawBuffer, s_AftDrawBufferSizeVanilla * 2);
+		if (ImmArena.growPending && imm->NumBuffers_0 == 0 && imm->field_8 == 0)
+			grow(imm, ImmArena, stats.immBuffer, "s_ImmDrawBuffer");
 	}
 
 public:
@@ -647,6 +1284,11 @@ public:
 };
 DrawBufferExtension DrawBufferExtension::instance;
 
+void DrawBuffers_FrameDone(int aftEntries, int aftUnkEntries)
+{
+	DrawBufferExtension::frame_done(aftEntries, aftUnkEntries);
+}
+
 class PauseMenuVisibility : public Hook
 {
 	inline static SafetyHookInline sprani_hook = {};
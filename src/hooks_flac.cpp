@@ -1,10 +1,11 @@
 #include "hook_mgr.hpp"
 #include "plugin.hpp"
 #include "game_addrs.hpp"
+#include "bgm_cache.hpp"
+#include "flac_stream.hpp"
 #include <mmiscapi.h>
 #include <mmreg.h>
 #include <fstream>
-#include <FLAC/stream_decoder.h>
 
 namespace Settings
 {
@@ -42,6 +43,8 @@ public:
 
 CWaveFile::~CWaveFile() {}
 
+// The game only ever talks to CFLACFile through CWaveFile's vtable; the actual
+// decoding is done by FLACStream.
 class CFLACFile : public CWaveFile
 {
 public:
@@ -56,30 +59,20 @@ public:
     HRESULT ResetFile();
 
 private:
-    FLAC__StreamDecoder* m_pDecoder;
-    std::vector<BYTE> m_pDecodedData;
-    DWORD m_dwDecodedDataSize;
-    DWORD m_dwCurrentPosition;
+    static constexpr DWORD ReadTimeoutMs = 200;
 
-    FLAC__uint64 m_currentSample;
+    FLACStream m_stream;
 
-    bool m_loopEnabled;
-    FLAC__uint64 m_loopStart;
-    FLAC__uint64 m_loopEnd;
-
-    // FLAC callbacks
-    static FLAC__StreamDecoderWriteStatus WriteCallback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* client_data);
-    static void MetadataCallback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata, void* client_data);
-    static void ErrorCallback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status, void* client_data);
+    // Keeps a BGM cache mapping alive while we decode from it
+    std::shared_ptr<const BGMCache::MappedFile> m_mappedFile;
 
     // Helper functions
-    HRESULT DecodeFile();
-    void EnsureBufferSize(size_t requiredSize);
-    bool SeekToSample(FLAC__uint64 sample);
+    HRESULT OpenDone(const char* name, bool opened);
 };
 
-CFLACFile::CFLACFile() : m_pDecoder(NULL), m_dwDecodedDataSize(0), m_dwCurrentPosition(0), m_loopEnabled(false), m_currentSample(0)
+CFLACFile::CFLACFile()
 {
+    m_pwfx_4 = NULL;
 }
 
 CFLACFile::~CFLACFile()
@@ -89,91 +82,65 @@ CFLACFile::~CFLACFile()
 
 HRESULT CFLACFile::Open(LPSTR strFileName, WAVEFORMATEX* pwfx, DWORD dwFlags)
 {
-    // Initialize FLAC decoder
-    m_pDecoder = FLAC__stream_decoder_new();
-    if (m_pDecoder == NULL)
-        return E_FAIL;
-
-    // Set up callbacks
-    FLAC__stream_decoder_set_metadata_ignore_all(m_pDecoder);
-    FLAC__stream_decoder_set_metadata_respond(m_pDecoder, FLAC__METADATA_TYPE_STREAMINFO);
-    FLAC__stream_decoder_set_metadata_respond(m_pDecoder, FLAC__METADATA_TYPE_VORBIS_COMMENT);
-    FLAC__stream_decoder_init_file(m_pDecoder, strFileName, WriteCallback, MetadataCallback, ErrorCallback, this);
+    // CD switcher tracks the BGM cache has mapped are decoded from memory
+    if (auto file = BGMCache::FindFile(strFileName))
+    {
+        m_mappedFile = std::move(file);
+        return OpenDone(strFileName, m_stream.open_memory(m_mappedFile->data(), m_mappedFile->size()));
+    }
 
-    // Decode the entire file
-    return DecodeFile();
+    return OpenDone(strFileName, m_stream.open_file(strFileName));
 }
 
+// pbData has to stay valid until Close
 HRESULT CFLACFile::OpenFromMemory(BYTE* pbData, ULONG ulDataSize, WAVEFORMATEX* pwfx, DWORD dwFlags)
 {
-    OutputDebugString("CFLACFile::OpenFromMemory not implementamundo");
-    return 0;
+    return OpenDone("memory", m_stream.open_memory(pbData, ulDataSize));
 }
 
-HRESULT CFLACFile::Read(BYTE* pBuffer, DWORD dwSizeToRead, DWORD* pdwSizeRead)
+HRESULT CFLACFile::OpenDone(const char* name, bool opened)
 {
-    if (!m_pDecodedData.size())
-        return E_FAIL;
-
-    DWORD dwRead = 0;
-    DWORD dwRemaining = dwSizeToRead;
-
-    while (dwRemaining > 0)
+    if (!opened)
     {
-        // Check if we've reached the loop end
-        if (m_loopEnabled && m_currentSample >= m_loopEnd)
-        {
-            // Seek back to loop start
-            if (!SeekToSample(m_loopStart))
-                break;
-        }
+        spdlog::error("CFLACFile::Open - {}: {}", name, m_stream.error());
+        return E_FAIL;
+    }
 
-        DWORD numRead = dwRemaining;
-        if (m_loopEnabled)
-        {
-            FLAC__uint64 samplesUntilLoopEnd = m_loopEnd - m_currentSample;
-            DWORD bytesUntilLoopEnd = static_cast<DWORD>(samplesUntilLoopEnd * m_pwfx_4->nBlockAlign);
-            numRead = min(bytesUntilLoopEnd, numRead);
-        }
+    if (const std::string error = m_stream.error(); !error.empty())
+        spdlog::warn("CFLACFile::Open - {}: {}", name, error);
 
-        while (m_dwCurrentPosition + numRead > m_dwDecodedDataSize)
-        {
-            if (FLAC__stream_decoder_get_state(m_pDecoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
-                break;
+    const auto& loop = m_stream.loop();
+    if (loop.enabled)
+        spdlog::info("FLAC loop: {} - {}", loop.start, loop.end);
 
-            // Try to read two frames at a time, hopefully reduce any skipping...
-            if (!FLAC__stream_decoder_process_single(m_pDecoder))
-                break;
+    // Fill in WAVEFORMATEX structure
+    const auto& format = m_stream.format();
+    m_pwfx_4 = new WAVEFORMATEX;
+    m_pwfx_4->wFormatTag = WAVE_FORMAT_PCM;
+    m_pwfx_4->nChannels = WORD(format.channels);
+    m_pwfx_4->nSamplesPerSec = format.sampleRate;
+    m_pwfx_4->wBitsPerSample = WORD(format.bitsPerSample);
+    m_pwfx_4->nBlockAlign = WORD(format.blockAlign);
+    m_pwfx_4->nAvgBytesPerSec = m_pwfx_4->nSamplesPerSec * m_pwfx_4->nBlockAlign;
+    m_pwfx_4->cbSize = 0;
 
-            if (!FLAC__stream_decoder_process_single(m_pDecoder))
-                break;
-        }
+    return S_OK;
+}
 
-        DWORD dwAvailable = m_dwDecodedDataSize - m_dwCurrentPosition;
-        DWORD dwToRead = min(dwAvailable, numRead);
-        if (dwToRead == 0)
-            break;
+HRESULT CFLACFile::Read(BYTE* pBuffer, DWORD dwSizeToRead, DWORD* pdwSizeRead)
+{
+    if (!m_pwfx_4)
+        return E_FAIL;
 
-        memcpy(pBuffer + dwRead, m_pDecodedData.data() + m_dwCurrentPosition, dwToRead);
-        m_dwCurrentPosition += dwToRead;
-        m_currentSample += dwToRead / m_pwfx_4->nBlockAlign;
-        dwRead += dwToRead;
-        dwRemaining -= dwToRead;
-    }
+    // Don't hold up the game's sound thread for long if the decoder has stalled
+    const size_t read = m_stream.read(pBuffer, dwSizeToRead, std::chrono::milliseconds(ReadTimeoutMs));
 
     if (pdwSizeRead)
-        *pdwSizeRead = dwRead;
+        *pdwSizeRead = DWORD(read);
 
     return S_OK;
 }
 
-bool CFLACFile::SeekToSample(FLAC__uint64 sample)
-{
-    m_currentSample = sample;
-    m_dwCurrentPosition = static_cast<DWORD>(sample * m_pwfx_4->nBlockAlign);
-    return true;
-}
-
 HRESULT CFLACFile::Write(UINT nSizeToWrite, BYTE* pbSrcData, UINT* pnSizeWrote)
 {
     OutputDebugString("Negatory on the CFLACFile::Write");
@@ -187,172 +154,21 @@ int CFLACFile::GetSize()
 
 HRESULT CFLACFile::Close()
 {
-    if (m_pDecoder)
-    {
-        FLAC__stream_decoder_finish(m_pDecoder);
-        FLAC__stream_decoder_delete(m_pDecoder);
-        m_pDecoder = NULL;
-    }
+    if (const unsigned underruns = m_stream.underruns())
+        spdlog::warn("CFLACFile::Close - decoder fell behind playback {} times", underruns);
 
-    m_pDecodedData.clear();
-    m_dwDecodedDataSize = 0;
-    m_dwCurrentPosition = 0;
+    m_stream.close();
+    m_mappedFile.reset();
 
     return S_OK;
 }
 
 HRESULT CFLACFile::ResetFile()
 {
-    m_dwCurrentPosition = 0;
-    return S_OK;
-}
-
-HRESULT CFLACFile::DecodeFile()
-{
-    if (!FLAC__stream_decoder_process_until_end_of_metadata(m_pDecoder))
-        return E_FAIL;
-
-    if (!FLAC__stream_decoder_process_single(m_pDecoder))
-        return E_FAIL;
-
+    m_stream.reset();
     return S_OK;
 }
 
-void CFLACFile::EnsureBufferSize(size_t requiredSize)
-{
-    if (m_pDecodedData.size() < requiredSize)
-    {
-        size_t newCapacity = m_pDecodedData.size();
-        if (!newCapacity)
-            newCapacity = requiredSize;
-        while (newCapacity < requiredSize)
-            newCapacity *= 2;  // Double the capacity
-        m_pDecodedData.resize(newCapacity);
-    }
-}
-
-FLAC__StreamDecoderWriteStatus CFLACFile::WriteCallback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* client_data)
-{
-    CFLACFile* pThis = static_cast<CFLACFile*>(client_data);
-
-    const unsigned int bps = frame->header.bits_per_sample;
-    const DWORD totalSamples = frame->header.blocksize * frame->header.channels;
-    const DWORD bytesPerSample = bps / 8;
-    const DWORD totalBytes = totalSamples * bytesPerSample;
-
-    // Ensure buffer is large enough
-    size_t requiredSize = pThis->m_dwDecodedDataSize + totalBytes;
-    pThis->EnsureBufferSize(requiredSize);
-
-    // Append decoded FLAC samples to m_pDecodedData
-    unsigned char* outBuffer = pThis->m_pDecodedData.data() + pThis->m_dwDecodedDataSize;
-
-    for (unsigned int i = 0; i < frame->header.blocksize; i++)
-    {
-        for (unsigned int channel = 0; channel < frame->header.channels; channel++)
-        {
-            FLAC__int32 sample = buffer[channel][i];
-
-            // Handle different bit depths
-            switch (bps) {
-            case 16:
-            {
-                INT16 pcm = static_cast<INT16>(max(-32768, min(32767, sample)));
-                *(INT16*)outBuffer = pcm;
-                outBuffer += sizeof(INT16);
-            }
-            break;
-            case 24:
-            {
-                outBuffer[0] = (sample & 0xFF);
-                outBuffer[1] = ((sample >> 8) & 0xFF);
-                outBuffer[2] = ((sample >> 16) & 0xFF);
-                outBuffer += 3;
-            }
-            break;
-            case 32:
-                *(FLAC__int32*)outBuffer = sample;
-                outBuffer += sizeof(FLAC__int32);
-                break;
-            default:
-                // Unsupported bit depth
-                return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-            }
-        }
-    }
-
-    pThis->m_dwDecodedDataSize += totalBytes;
-
-    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
-}
-
-void CFLACFile::MetadataCallback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata, void* client_data)
-{
-    CFLACFile* pThis = static_cast<CFLACFile*>(client_data);
-
-    if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
-    {
-        // Fill in WAVEFORMATEX structure
-        pThis->m_pwfx_4 = new WAVEFORMATEX;
-        pThis->m_pwfx_4->wFormatTag = WAVE_FORMAT_PCM;
-        pThis->m_pwfx_4->nChannels = metadata->data.stream_info.channels;
-        pThis->m_pwfx_4->nSamplesPerSec = metadata->data.stream_info.sample_rate;
-        pThis->m_pwfx_4->wBitsPerSample = metadata->data.stream_info.bits_per_sample;
-        pThis->m_pwfx_4->nBlockAlign = (pThis->m_pwfx_4->nChannels * pThis->m_pwfx_4->wBitsPerSample) / 8;
-        pThis->m_pwfx_4->nAvgBytesPerSec = pThis->m_pwfx_4->nSamplesPerSec * pThis->m_pwfx_4->nBlockAlign;
-        pThis->m_pwfx_4->cbSize = 0;
-
-        // Pre-allocate buffer for decoded data
-        FLAC__uint64 totalSamples = metadata->data.stream_info.total_samples;
-        unsigned channels = metadata->data.stream_info.channels;
-        unsigned bitsPerSample = metadata->data.stream_info.bits_per_sample;
-
-        // Calculate total buffer size in bytes
-        size_t totalBufferSize = totalSamples * channels * (bitsPerSample / 8);
-
-        // Pre-allocate the buffer
-        pThis->m_pDecodedData.reserve(totalBufferSize);
-    }
-    else if (metadata->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
-    {
-        std::optional<FLAC__uint64> loop_start;
-        std::optional<FLAC__uint64> loop_length;
-        std::optional<FLAC__uint64> loop_end;
-        for (unsigned int i = 0; i < metadata->data.vorbis_comment.num_comments; i++)
-        {
-            const char* tag = (const char*)metadata->data.vorbis_comment.comments[i].entry;
-            unsigned int length = metadata->data.vorbis_comment.comments[i].length;
-            spdlog::debug("FLAC comment: size {}, {}", length, tag);
-
-            if (length > 10 && !_strnicmp(tag, "LOOPSTART=", 10))
-                loop_start = std::stoull(tag + 10, NULL, 10);
-            else if (length > 11 && !_strnicmp(tag, "LOOPLENGTH=", 11))
-                loop_length = std::stoull(tag + 11, NULL, 10);
-            else if (length > 8 && !_strnicmp(tag, "LOOPEND=", 8))
-                loop_end = std::stoull(tag + 8, NULL, 10);
-        }
-
-        if (loop_start.has_value() && loop_length.has_value())
-            loop_end = loop_start.value() + loop_length.value() - 1;
-
-        if (loop_start.has_value() && loop_end.has_value())
-        {
-            spdlog::info("FLAC loop: {} - {}", loop_start.value(), loop_end.value());
-            pThis->m_loopStart = loop_start.value();
-            pThis->m_loopEnd = loop_end.value();
-            pThis->m_loopEnabled = true;
-        }
-    }
-}
-
-void CFLACFile::ErrorCallback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status, void* client_data)
-{
-    // Log the error
-    OutputDebugString("FLAC decoding error: ");
-    OutputDebugString(FLAC__StreamDecoderErrorStatusString[status]);
-    OutputDebugString("\n");
-}
-
 class AllowFLAC : public Hook
 {
     inline static SafetyHookMid hook = {};
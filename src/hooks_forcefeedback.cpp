@@ -7,6 +7,10 @@
 
 #include "Xinput.h"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 namespace Settings
 {
 	Setting<int> VibrationMode{ "Controls", "VibrationMode", 0,
@@ -20,6 +24,115 @@ namespace Settings
 		Range<int>{ 0, 4 } };
 }
 
+void InputManager_SetVibration(WORD, WORD);
+
+// Rumble is sent from its own thread. SDL_RumbleGamepad and XInputSetState
+// (plus ImpulseVibration's WriteFile underneath it) all end up writing to the
+// device, which on some Bluetooth pads blocks long enough to drop frames.
+// The game thread only swaps the latest motor speeds into Mailbox, waking the
+// thread if they changed; the thread sends whatever is newest when it gets
+// to it, so a burst of updates costs one write.
+namespace RumbleDispatch
+{
+    // Changes smaller than this aren't worth a write, the motors can't show them
+    constexpr int ChangeThreshold = 0x400;
+
+    // Never send more often than once a frame at 60fps
+    constexpr DWORD MinIntervalMs = 16;
+
+    // SDL stops rumbling after the 1000ms duration setVibration passes it,
+    // so a steady rumble has to be sent again before then
+    constexpr DWORD RefreshMs = 500;
+
+    // Valid bit | userId << 32 | left << 16 | right
+    constexpr uint64_t Valid = 1ull << 63;
+    static std::atomic<uint64_t> Mailbox = 0;
+    static HANDLE Wake = nullptr;
+
+    static uint64_t Pack(int userId, WORD left, WORD right)
+    {
+        return Valid | (uint64_t(uint8_t(userId)) << 32) | (uint64_t(left) << 16) | right;
+    }
+
+    static bool Differs(uint64_t a, uint64_t b)
+    {
+        if ((a >> 32) != (b >> 32))
+            return true;
+
+        // Starting or stopping always counts, however small
+        const WORD aLeft = WORD(a >> 16), aRight = WORD(a);
+        const WORD bLeft = WORD(b >> 16), bRight = WORD(b);
+        if ((aLeft == 0) != (bLeft == 0) || (aRight == 0) != (bRight == 0))
+            return true;
+
+        return abs(aLeft - bLeft) >= ChangeThreshold || abs(aRight - bRight) >= ChangeThreshold;
+    }
+
+    static void Send(uint64_t packed)
+    {
+        XINPUT_VIBRATION vib{ 0 };
+        vib.wLeftMotorSpeed = WORD(packed >> 16);
+        vib.wRightMotorSpeed = WORD(packed);
+
+        InputManager_SetVibration(vib.wLeftMotorSpeed, vib.wRightMotorSpeed);
+
+        if (!Settings::UseNewInput)
+            XInputSetState(DWORD((packed >> 32) & 0xFF), &vib);
+    }
+
+    static void DispatchThread()
+    {
+#ifdef _DEBUG
+        SetThreadDescription(GetCurrentThread(), L"RumbleDispatchThread");
+#endif
+
+        uint64_t sent = 0;
+        ULONGLONG lastSend = 0;
+        DWORD timeout = INFINITE;
+
+        for (;;)
+        {
+            WaitForSingleObject(Wake, timeout);
+
+            const uint64_t latest = Mailbox.load(std::memory_order_acquire);
+            const bool motorsOn = (latest & 0xFFFFFFFF) != 0;
+            const ULONGLONG sinceSend = GetTickCount64() - lastSend;
+
+            if (!Differs(latest, sent) && !(motorsOn && sinceSend >= RefreshMs))
+            {
+                timeout = motorsOn ? DWORD(RefreshMs - sinceSend) : INFINITE;
+                continue;
+            }
+
+            // Come back once the interval is up, by then there may be something newer
+            if (sinceSend < MinIntervalMs)
+            {
+                timeout = DWORD(MinIntervalMs - sinceSend);
+                continue;
+            }
+
+            Send(latest);
+            sent = latest;
+            lastSend = GetTickCount64();
+            timeout = motorsOn ? RefreshMs : INFINITE;
+        }
+    }
+
+    static void Post(int userId, WORD left, WORD right)
+    {
+        const uint64_t packed = Pack(userId, left, right);
+        if (Mailbox.exchange(packed, std::memory_order_acq_rel) != packed)
+            SetEvent(Wake);
+    }
+
+    static void Start()
+    {
+        Wake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+
+        std::thread(DispatchThread).detach();
+    }
+}
+
 int VibrationUserId = 0;
 int VibrationStrength = 10;
 float VibrationLeftMotor = 0.f;
@@ -40,15 +153,9 @@ void SetVibration(int userId, float leftMotor, float rightMotor)
         leftMotor = rightMotor = max(leftMotor, rightMotor);
     }
 
-    XINPUT_VIBRATION vib{ 0 };
-    vib.wLeftMotorSpeed = uint16_t(std::clamp(int(leftMotor * 65535.f), 0, 0xFFFF));
-    vib.wRightMotorSpeed = uint16_t(std::clamp(int(rightMotor * 65535.f), 0, 0xFFFF));
-
-    void InputManager_SetVibration(WORD, WORD);
-    InputManager_SetVibration(vib.wLeftMotorSpeed, vib.wRightMotorSpeed);
-
-	if (!Settings::UseNewInput)
-		XInputSetState(userId, &vib);
+    RumbleDispatch::Post(userId,
+        uint16_t(std::clamp(int(leftMotor * 65535.f), 0, 0xFFFF)),
+        uint16_t(std::clamp(int(rightMotor * 65535.f), 0, 0xFFFF)));
 }
 
 extern "C"
@@ -91,6 +198,8 @@ public:
 
         GamePlCar_Ctrl = safetyhook::create_inline(Module::exe_ptr(GamePlCar_Ctrl_Addr), GamePlCar_Ctrl_Hook);
 
+        RumbleDispatch::Start();
+
         return true;
     }
 
@@ -3,6 +3,10 @@
 #include "game_addrs.hpp"
 #include "overlay/overlay.hpp"
 #include "interpolation.hpp"
+#include "frame_pacing.hpp"
+#include "frame_telemetry.hpp"
+#include "render_stats.hpp"
+#include "input_sampler.hpp"
 
 // from timeapi.h, which we can't include since our proxy timeBeginPeriod etc funcs will conflict...
 typedef struct timecaps_tag {
@@ -30,7 +34,12 @@ namespace Settings
 		"Smooths car & camera movement when running above 60FPS, by interpolating positions between game ticks. "
 		"Requires FramerateLimit to be set above 60 (or set to 0). EXPERIMENTAL: may cause visual glitches, disable if you notice any." };
 	Setting<int> FramerateLimitMode{ "Performance", "FramerateLimitMode", 0,
-		"Efficient should work fine for most people, but if you have issues it might be worth trying accurate mode.", { "Efficient", "Accurate" } };
+		"Efficient should work fine for most people, but if you have issues it might be worth trying accurate mode. "
+		"Adaptive releases each frame early by how long it expects the frame to take, so frames are presented at a steady rate even as load changes.",
+		{ "Efficient", "Accurate", "Adaptive" } };
+	Setting<bool> FramerateLowLatency{ "Performance", "FramerateLowLatency", false,
+		"Schedules each frame around input latency: per-tick chores run before the framelimiter wait instead of after it, "
+		"so input is sampled as soon as the wait ends, and controller events are still pumped on frames that run no game tick." };
 	Setting<bool> FramerateUnlockExperimental{ "Performance", "FramerateUnlockExperimental", true,
 		"Allows the game to render more than one frame per 60Hz game tick, which everything above 60FPS depends on." };
 }
@@ -143,31 +152,91 @@ public:
 //
 namespace SumoUISpriteReplay
 {
-	// One captured draw. kind_C selects which payload struct the draw uses and
-	// the other is left zeroed, so keeping both avoids interpreting either.
-	struct Entry
+	// Captured draws are packed back to back: a header, then only the payload
+	// the draw's kind_C uses. put_sprite_ex queues kind 0 from args_10 and
+	// put_sprite_ex2 kind 1 from args2_58, leaving the other zeroed, so most of
+	// a node is never worth copying. A kind neither of those would queue keeps
+	// both, so nothing is lost if one ever turns up.
+	struct Header
 	{
-		float priority;
+		uint8_t priority;
+		uint8_t payload; // PayloadArgs and/or PayloadArgs2
+		uint16_t size;   // header included, so the next one is at this + size
 		uint32_t kind;
-		SPRARGS args;
-		SPRARGS2 args2;
 	};
 
-	static Entry Captured[Game::SpriteNodeMax];
+	constexpr uint8_t PayloadArgs = 1;
+	constexpr uint8_t PayloadArgs2 = 2;
+
+	constexpr size_t MaxEntrySize = sizeof(Header) + sizeof(SPRARGS) + sizeof(SPRARGS2);
+
+	alignas(8) static uint8_t Arena[Game::SpriteNodeMax * MaxEntrySize];
+	static size_t ArenaSize = 0;
 	static int CapturedCount = 0;
 
+	static uint8_t payload_for(uint32_t kind)
+	{
+		switch (kind)
+		{
+		case 0:  return PayloadArgs;
+		case 1:  return PayloadArgs2;
+		default: return PayloadArgs | PayloadArgs2;
+		}
+	}
+
 	static bool available()
 	{
 		return Game::sprite_prio_root && Game::put_sprite_ex;
 	}
 
+	// Builds one packed entry for a node into out, returning its size.
+	static size_t pack(uint8_t* out, int prio, const SpriteNode* node)
+	{
+		Header header{};
+		header.priority = uint8_t(prio);
+		header.kind = node->kind_C;
+		header.payload = payload_for(node->kind_C);
+
+		size_t size = sizeof(Header);
+		if (header.payload & PayloadArgs)
+		{
+			memcpy(out + size, &node->args_10, sizeof(SPRARGS));
+			size += sizeof(SPRARGS);
+		}
+		if (header.payload & PayloadArgs2)
+		{
+			memcpy(out + size, &node->args2_58, sizeof(SPRARGS2));
+			size += sizeof(SPRARGS2);
+		}
+
+		header.size = uint16_t(size);
+		memcpy(out, &header, sizeof(Header));
+		return size;
+	}
+
 	// Copies out every pending draw. The walk matches draw_entried_sprites: one
 	// list head per priority, first node at next_0, then next_0 node to node.
-	static void capture()
+	//
+	// Menus mostly queue the same draws tick after tick, so each entry is first
+	// built on the side and compared with what is already there. Only once one
+	// differs does the arena get written, from that entry on. Returns false if
+	// the queue came out byte-identical to the last capture.
+	static bool capture()
 	{
-		CapturedCount = 0;
 		if (!available())
-			return;
+		{
+			ArenaSize = 0;
+			CapturedCount = 0;
+			return true;
+		}
+
+		const size_t prevSize = ArenaSize;
+		const int prevCount = CapturedCount;
+
+		size_t offset = 0;
+		int count = 0;
+		bool same = true;
+		uint8_t scratch[MaxEntrySize];
 
 		for (int prio = 0; prio < Game::SpritePriorityCount; prio++)
 		{
@@ -178,16 +247,34 @@ namespace SumoUISpriteReplay
 			for (const SpriteNode* node = root->next_0; node; node = node->next_0)
 			{
 				// The node pool is SpriteNodeMax entries, so the queue can't exceed it.
-				if (CapturedCount >= Game::SpriteNodeMax)
-					return;
-
-				Entry& entry = Captured[CapturedCount++];
-				entry.priority = float(prio);
-				entry.kind = node->kind_C;
-				entry.args = node->args_10;
-				entry.args2 = node->args2_58;
+				if (count >= Game::SpriteNodeMax)
+					break;
+
+				if (same)
+				{
+					const size_t size = pack(scratch, prio, node);
+					if (offset + size <= prevSize && !memcmp(Arena + offset, scratch, size))
+					{
+						offset += size;
+						count++;
+						continue;
+					}
+
+					same = false;
+					memcpy(Arena + offset, scratch, size);
+					offset += size;
+				}
+				else
+					offset += pack(Arena + offset, prio, node);
+
+				count++;
 			}
 		}
+
+		ArenaSize = offset;
+		CapturedCount = count;
+
+		return !same || offset != prevSize || count != prevCount;
 	}
 
 	// Puts the captured draws back, in capture order and at the same point in the
@@ -204,16 +291,34 @@ namespace SumoUISpriteReplay
 		if (!available())
 			return;
 
+		static const SPRARGS ZeroArgs{};
+		static const SPRARGS2 ZeroArgs2{};
+
+		size_t offset = 0;
 		for (int i = 0; i < CapturedCount; i++)
 		{
-			const Entry& entry = Captured[i];
-			const int prio = int(entry.priority);
+			Header header;
+			memcpy(&header, Arena + offset, sizeof(Header));
+
+			const uint8_t* payload = Arena + offset + sizeof(Header);
+			offset += header.size;
 
+			const SPRARGS* args = &ZeroArgs;
+			const SPRARGS2* args2 = &ZeroArgs2;
+			if (header.payload & PayloadArgs)
+			{
+				args = reinterpret_cast<const SPRARGS*>(payload);
+				payload += sizeof(SPRARGS);
+			}
+			if (header.payload & PayloadArgs2)
+				args2 = reinterpret_cast<const SPRARGS2*>(payload);
+
+			const int prio = header.priority;
 			const SpriteNode* before = Game::sprite_prio_root[prio];
 			const SpriteNode* tailBefore = before ? before->tail_4 : nullptr;
 
-			SPRARGS scratch = entry.args;
-			Game::put_sprite_ex(&scratch, entry.priority);
+			SPRARGS scratch = *args;
+			Game::put_sprite_ex(&scratch, float(prio));
 
 			// tail_4 is the node linked last, so an unchanged tail means the
 			// pool was full and nothing was linked.
@@ -222,19 +327,40 @@ namespace SumoUISpriteReplay
 			if (!node || node == tailBefore)
 				continue;
 
-			node->kind_C = entry.kind;
-			node->args_10 = entry.args;
-			node->args2_58 = entry.args2;
+			node->kind_C = header.kind;
+			node->args_10 = *args;
+			node->args2_58 = *args2;
 		}
 	}
 
 	// Call once per rendered frame, after the tick loop, before the render path.
-	static void update(int numUpdates)
+	// Costs are timed for the Debug tab, since at high framerates this runs on
+	// nearly every frame.
+	static void update(int numUpdates, double qpcFreqMs)
 	{
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+
+		auto& stats = FramePacing::Stats;
+
 		if (numUpdates > 0)
-			capture();
+		{
+			if (!capture())
+				stats.spriteCapturesUnchanged++;
+			stats.spriteCapturesTotal++;
+		}
 		else
 			replay();
+
+		QueryPerformanceCounter(&end);
+		const float ms = float(double(end.QuadPart - start.QuadPart) / qpcFreqMs);
+		if (numUpdates > 0)
+			stats.spriteCaptureCost.add(ms);
+		else
+			stats.spriteReplayCost.add(ms);
+
+		stats.spriteCapturedCount = CapturedCount;
+		stats.spriteCapturedBytes = int(ArenaSize);
 	}
 }
 
@@ -272,6 +398,19 @@ class ReplaceGameUpdateLoop : public Hook
 	// request servers it drives are bounded the same way.
 	static constexpr double FileLoadSliceMs = 0.5;
 
+	// A slice that comes back quicker than this built nothing, it only found
+	// the read it needs still being made by the game's loader thread.
+	static constexpr double FileLoadIdleSliceMs = 0.05;
+
+	// Longest to sleep on the loader thread before trying another slice. The
+	// wait ends as soon as the loader finishes a read, this only bounds it for
+	// the case where what we're waiting on isn't a read at all.
+	static constexpr double FileLoadWaitMs = 2.0;
+
+	// Time PumpFileLoader spent asleep on the loader during the current load
+	// screen, in ms.
+	inline static double FileLoadWaitTotalMs = 0;
+
 	// FileLoad_Ctrl returns zero once every request server has run dry, so one
 	// call answers immediately when there is nothing to load and today's single
 	// call per sleep is all an idle frame pays. While a load is running though
@@ -279,26 +418,241 @@ class ReplaceGameUpdateLoop : public Hook
 	// milliseconds, leaving the loader idle for most of the wait. Keep handing it
 	// slices until it reports nothing left or the frame no longer has room for
 	// another, so the limiter still releases the frame on time.
+	//
+	// The reads themselves are made on the game's loader thread, so a slice
+	// that is only waiting on one returns straight away. Sleep until the loader
+	// moves on rather than spinning slices until it does.
 	static void PumpFileLoader(double deadline)
 	{
 		LARGE_INTEGER counter;
 
 		for (;;)
 		{
+			QueryPerformanceCounter(&counter);
+			const double sliceStart = double(counter.QuadPart) / FramelimiterFrequency;
+
 			if (!Game::FileLoad_Ctrl())
 				return;
 
 			QueryPerformanceCounter(&counter);
-			if (deadline - (double(counter.QuadPart) / FramelimiterFrequency) <= FileLoadSliceMs)
+			const double now = double(counter.QuadPart) / FramelimiterFrequency;
+			const double remaining = deadline - now;
+			if (remaining <= FileLoadSliceMs)
 				return;
+
+			if (now - sliceStart < FileLoadIdleSliceMs)
+			{
+				// WaitForSingleObject counts whole milliseconds, anything shorter
+				// than one is left to spin.
+				const double waitMs = min(remaining - FileLoadSliceMs, FileLoadWaitMs);
+				if (waitMs >= 1.0)
+				{
+					FileLoad_WaitForLoader(DWORD(waitMs));
+
+					QueryPerformanceCounter(&counter);
+					FileLoadWaitTotalMs += double(counter.QuadPart) / FramelimiterFrequency - now;
+				}
+			}
+		}
+	}
+
+	// Load screens are timed and logged, so that FramerateFastLoad modes, or
+	// builds, can be compared on the same stage.
+	inline static int64_t LoadScreenStartQpc = 0;
+	static void TimeLoadScreen(GameState curGameState, int64_t now)
+	{
+		const bool isLoadScreen = curGameState == STATE_START && *Game::game_start_progress_code != 65;
+
+		if (isLoadScreen && !LoadScreenStartQpc)
+		{
+			LoadScreenStartQpc = now;
+			FileLoadWaitTotalMs = 0;
+		}
+		else if (!isLoadScreen && LoadScreenStartQpc)
+		{
+			auto& stats = FramePacing::Stats;
+			stats.lastLoadMs = float(double(now - LoadScreenStartQpc) / FramelimiterFrequency);
+			stats.lastLoadWaitMs = float(FileLoadWaitTotalMs);
+			LoadScreenStartQpc = 0;
+
+			spdlog::info("ReplaceGameUpdateLoop: load screen took {:.0f}ms ({:.0f}ms waiting on the loader thread), FramerateFastLoad {}",
+				stats.lastLoadMs, stats.lastLoadWaitMs, Settings::FramerateFastLoad.get());
 		}
 	}
 
+	// QPC time the last tick of the previous frame sampled input at, or 0 if
+	// that frame ran no tick.
+	inline static int64_t PendingInputSampleQpc = 0;
+	inline static int64_t PacingWindowStartQpc = 0;
+
+	// QPC times the previous frame passed through this hook: entry, the end of
+	// the limiter wait, the end of its ticks, and exit. Zero before the first.
+	inline static int64_t PrevEntryQpc = 0;
+	inline static int64_t ReleaseQpc = 0;
+	inline static int64_t TicksDoneQpc = 0;
+	inline static int64_t ExitQpc = 0;
+	inline static int64_t LimiterStartQpc = 0;
+
+	// The rest of the previous frame's telemetry record, which is finished off
+	// once its Present time is known.
+	inline static Telemetry::Frame PendingFrame;
+
+	// Deadline the previous frame was released against, in ms, for measuring
+	// how far from it the frame's Present actually landed. 0 when the limiter
+	// didn't run.
+	inline static double PrevDeadline = 0;
+
+	static float QpcToMs(int64_t qpc)
+	{
+		return float(double(qpc) / FramelimiterFrequency);
+	}
+
+	// With vsync on, EndScene to Present is mostly the wait for vblank rather
+	// than work the frame had to do.
+	static bool VsyncEnabled()
+	{
+		const UINT interval = Game::D3DPresentParams->PresentationInterval;
+		return interval != 0 && interval != D3DPRESENT_INTERVAL_IMMEDIATE;
+	}
+
+	// The settings input latency is grouped by in the telemetry window
+	static Telemetry::LatencyConfig CurrentLatencyConfig()
+	{
+		Telemetry::LatencyConfig config;
+		config.limitMode = Settings::FramerateLimitMode;
+		config.limit = Settings::FramerateLimit;
+		config.vsync = VsyncEnabled();
+		config.interpolation = Settings::FramerateUnlockExperimental && Settings::FramerateInterpolation;
+		config.lowLatency = Settings::FramerateLowLatency;
+		config.samplingThread = InputSampler::Running();
+		return config;
+	}
+
+	// The previous frame's Present has returned by the time the loop comes back
+	// round to this hook, so entering it stands in for the present timestamp.
+	static void UpdatePacingStats(int64_t now)
+	{
+		auto& stats = FramePacing::Stats;
+
+		if (PendingInputSampleQpc)
+		{
+			stats.inputToPresent.add(QpcToMs(now - PendingInputSampleQpc));
+			PendingInputSampleQpc = 0;
+		}
+
+		if (ExitQpc)
+		{
+			Telemetry::Frame& frame = PendingFrame;
+
+			// EndScene runs between our exit and the next entry, unless the
+			// frame was skipped or the overlay hook isn't in.
+			if (stats.endSceneQpc > ExitQpc && stats.endSceneQpc <= now)
+			{
+				frame.drawMs = QpcToMs(stats.endSceneQpc - ExitQpc);
+				frame.presentMs = QpcToMs(now - stats.endSceneQpc);
+				stats.drawCost.add(frame.drawMs);
+				stats.presentCost.add(frame.presentMs);
+
+				stats.frameWork.add(frame.tickMs + frame.interpMs + frame.drawMs + (VsyncEnabled() ? 0.0f : frame.presentMs));
+			}
+
+			frame.frameMs = QpcToMs(now - PrevEntryQpc);
+
+			RenderStats::EndFrame(frame.stage);
+			const auto& render = RenderStats::Stats.last;
+			frame.nodesGathered = render.nodesGathered;
+			frame.nodesExcluded = render.nodesExcluded;
+			frame.objectsDrawn = render.objectsDrawn;
+			frame.immEntries = render.immEntries;
+			frame.aftEntries = render.aftEntries;
+			frame.sortMs = render.sortMs;
+			frame.stageDrawMs = render.stageDrawMs;
+
+			Telemetry::AddFrame(frame);
+			frame = {};
+
+			stats.presentInterval.add(QpcToMs(now - PrevEntryQpc));
+
+			if (PrevDeadline > 0)
+				stats.presentError.add(float(double(now) / FramelimiterFrequency - PrevDeadline));
+		}
+		PrevEntryQpc = now;
+
+		// After AddFrame, so presses are tied to the frame that was just presented
+		if (Telemetry::LatencyActive())
+			Telemetry::FramePresented(now, CurrentLatencyConfig());
+
+		if (double(now - PacingWindowStartQpc) / FramelimiterFrequency >= 1000.0)
+		{
+			stats.inputToPresent.publish();
+			stats.presentInterval.publish();
+			stats.presentError.publish();
+			PacingWindowStartQpc = now;
+		}
+	}
+
+	// How much earlier than its deadline the adaptive limiter should release
+	// the next frame: the ticks it will run, the interpolation, and the render
+	// path. Present is left out when vsync is on, since there it is mostly
+	// the wait for vblank and that lines itself up regardless.
+	//
+	// Capped to part of the frame, so a hitch that blows the estimates up can
+	// never turn the limiter off entirely.
+	static double AdaptiveWakeLead(double targetFrametime)
+	{
+		const auto& stats = FramePacing::Stats;
+
+		double lead = stats.predictedTicks * stats.tickCost.budgetMs()
+			+ stats.interpCost.budgetMs()
+			+ stats.drawCost.budgetMs();
+
+		if (!VsyncEnabled())
+			lead += stats.presentCost.budgetMs();
+
+		return std::clamp(lead, 0.0, targetFrametime * 0.75);
+	}
+
+	// CalcNumUpdatesToRun ticks once per whole 60th of a second elapsed, carrying
+	// the rest in frameskip_remainder. If the next frame is released one interval
+	// from now, its tick count is that carry plus the interval, in ticks.
+	static int PredictTicks(double targetFrametime, int minUpdates)
+	{
+		const double carry = double(*Game::frameskip_remainder) * 60.0 / (FramelimiterFrequency * 1000.0);
+		return max(int(carry + targetFrametime * 60.0 / 1000.0), minUpdates);
+	}
+
+	// Once-per-tick chores that don't read input. DInput_RegisterNewDevices can
+	// take a while on the frame after a device is plugged in.
+	inline static bool PrevFrameRanTick = false;
+	static void TickHousekeeping(GameState curGameState)
+	{
+		// Reset vibration if we're not in main game state
+		if (Settings::VibrationMode != 0 && curGameState != GameState::STATE_GAME)
+			SetVibration(Settings::VibrationControllerId, 0.0f, 0.0f);
+
+		if (Settings::ControllerHotPlug)
+			DInput_RegisterNewDevices();
+	}
+
 	inline static SafetyHookMid dest_hook = {};
 	static void destination(safetyhook::Context& ctx)
 	{
 		auto CurGameState = *Game::current_mode;
 
+		{
+			LARGE_INTEGER counter;
+			QueryPerformanceCounter(&counter);
+			UpdatePacingStats(counter.QuadPart);
+			TimeLoadScreen(CurGameState, counter.QuadPart);
+		}
+
+		// Anything run between the end of the wait and the first tick's input
+		// poll adds to how old that input is by the time it is shown. Low-latency
+		// mode does the chores here instead, before the wait. Whether this frame
+		// will tick isn't known until after it, so they follow the previous one.
+		if (Settings::FramerateLowLatency && PrevFrameRanTick)
+			TickHousekeeping(CurGameState);
+
 #ifdef _DEBUG
 		// TEMP: Allow toggling interpolation with K key
 		if (IsKeyPressed('K'))
@@ -355,6 +709,14 @@ class ReplaceGameUpdateLoop : public Hook
 			}
 		}
 
+		PrevDeadline = 0;
+
+		{
+			LARGE_INTEGER counter;
+			QueryPerformanceCounter(&counter);
+			LimiterStartQpc = counter.QuadPart;
+		}
+
 		if (!skipFrameLimiter)
 		{
 			// Framelimiter
@@ -364,19 +726,33 @@ class ReplaceGameUpdateLoop : public Hook
 			const double FramelimiterTargetFrametime = 1000.0 / double(Settings::FramerateLimit);
 			const double deadline = FramelimiterPrevCounter + FramelimiterTargetFrametime;
 
+			// Adaptive mode keeps the deadline timeline as it is, so the cadence
+			// doesn't drift, and only moves the release ahead of it. With the
+			// estimate right the frame's Present then lands on the deadline,
+			// however long the frame itself took.
+			double wakeAt = deadline;
+			if (Settings::FramerateLimitMode == 2)
+			{
+				const double lead = AdaptiveWakeLead(FramelimiterTargetFrametime);
+				FramePacing::Stats.wakeLeadMs = float(lead);
+				wakeAt -= lead;
+			}
+
+			PrevDeadline = deadline;
+
 			for (;;)
 			{
 				if (Settings::FramerateFastLoad == 3)
-					PumpFileLoader(deadline);
+					PumpFileLoader(wakeAt);
 
 				QueryPerformanceCounter(&counter);
 				timeCurrent = double(counter.QuadPart) / FramelimiterFrequency;
 
-				double remaining = deadline - timeCurrent;
+				double remaining = wakeAt - timeCurrent;
 				if (remaining <= 0.0)
 					break;
 
-				if (Settings::FramerateLimitMode != 0) // busy-wait mode
+				if (Settings::FramerateLimitMode == 1) // busy-wait mode
 				{
 					YieldProcessor();
 					continue;
@@ -407,6 +783,13 @@ class ReplaceGameUpdateLoop : public Hook
 				Game::FileLoad_Ctrl();
 		}
 
+		{
+			LARGE_INTEGER counter;
+			QueryPerformanceCounter(&counter);
+			ReleaseQpc = counter.QuadPart;
+			PendingFrame.sleepMs = QpcToMs(ReleaseQpc - LimiterStartQpc);
+		}
+
 		Game::SetFrameStartCpuTime();
 
 		int numUpdates = Game::CalcNumUpdatesToRun(60);
@@ -420,6 +803,9 @@ class ReplaceGameUpdateLoop : public Hook
 		if (numUpdates < minUpdates)
 			numUpdates = minUpdates;
 
+		if (Settings::FramerateLimit > 0)
+			FramePacing::Stats.predictedTicks = PredictTicks(1000.0 / double(Settings::FramerateLimit), minUpdates);
+
 		// need to call 43FA10 in order for "extend time" gfx to disappear
 		Game::fn43FA10(numUpdates);
 
@@ -429,21 +815,32 @@ class ReplaceGameUpdateLoop : public Hook
 		*Game::power_on_timer = *Game::power_on_timer + numUpdates;
 
 		AudioHooks_Update(numUpdates);
+		DrawDist_Update();
 
-		if (numUpdates > 0)
-		{
-			// Reset vibration if we're not in main game state
-			if (Settings::VibrationMode != 0 && CurGameState != GameState::STATE_GAME)
-				SetVibration(Settings::VibrationControllerId, 0.0f, 0.0f);
+		if (numUpdates > 0 && !Settings::FramerateLowLatency)
+			TickHousekeeping(CurGameState);
+
+		PrevFrameRanTick = numUpdates > 0;
 
-			if (Settings::ControllerHotPlug)
-				DInput_RegisterNewDevices();
+		// Nothing samples input on a frame without a tick. Draining SDL's event
+		// queue anyway keeps controller state current, and leaves the next tick's
+		// poll only the events since this frame to get through.
+		if (Settings::FramerateLowLatency && numUpdates == 0)
+		{
+			void InputManager_PumpEvents();
+			InputManager_PumpEvents();
 		}
 
 		for (int curUpdateIdx = 0; curUpdateIdx < numUpdates; curUpdateIdx++)
 		{
 			Interp::BeforeTick();
 
+			{
+				LARGE_INTEGER counter;
+				QueryPerformanceCounter(&counter);
+				FramePacing::Stats.inputSampleQpc = counter.QuadPart;
+			}
+
 			// Fetch latest input state
 			// (do this inside our update-loop so that any hooked game funcs have accurate state...)
 			Input::Update();
@@ -464,6 +861,15 @@ class ReplaceGameUpdateLoop : public Hook
 			Game::SoundControl_mb();
 			Game::LinkControlReceive();
 			Game::ModeControl();
+
+			// Any press InputManager passed on this tick has been acted on now
+			if (Telemetry::LatencyActive()) [[unlikely]]
+			{
+				LARGE_INTEGER counter;
+				QueryPerformanceCounter(&counter);
+				Telemetry::TickConsumed(counter.QuadPart);
+			}
+
 			Game::EventControl();
 			Game::GhostCarExecServer();
 			Game::fn4666A0();
@@ -471,10 +877,27 @@ class ReplaceGameUpdateLoop : public Hook
 			Interp::AfterTick();
 		}
 
+		// Only the last tick's input makes it into the frame being rendered.
+		if (numUpdates > 0)
+			PendingInputSampleQpc = FramePacing::Stats.inputSampleQpc;
+
+		{
+			LARGE_INTEGER counter;
+			QueryPerformanceCounter(&counter);
+			TicksDoneQpc = counter.QuadPart;
+
+			// Everything from the release to here, per tick. Frames without a
+			// tick say nothing about what one costs.
+			PendingFrame.tickMs = QpcToMs(TicksDoneQpc - ReleaseQpc);
+			PendingFrame.numUpdates = numUpdates;
+			if (numUpdates > 0)
+				FramePacing::Stats.tickCost.add(PendingFrame.tickMs / float(numUpdates));
+		}
+
 		// Keeps tick-drawn UI present on frames that skip a tick. Must sit after
 		// the last tick and before the render path queues any draw of its own.
 		if (Settings::FramerateUnlockExperimental)
-			SumoUISpriteReplay::update(numUpdates);
+			SumoUISpriteReplay::update(numUpdates, FramelimiterFrequency);
 
 		// Re-run the display-matrix builders with a fractional alpha. Must be
 		// the last thing we do: the mid-hook returns straight into the game's
@@ -485,6 +908,19 @@ class ReplaceGameUpdateLoop : public Hook
 		// a frame behind rather than smoothly between frames.
 		if (Settings::FramerateUnlockExperimental && Settings::FramerateInterpolation)
 			Interp::AfterTicks(FramelimiterFrequency);
+
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		ExitQpc = counter.QuadPart;
+		PendingFrame.interpMs = QpcToMs(ExitQpc - TicksDoneQpc);
+		FramePacing::Stats.interpCost.add(PendingFrame.interpMs);
+
+		if (Game::is_in_game())
+		{
+			PendingFrame.stage = int(*Game::stg_stage_num);
+			if (EVWORK_CAR* car = Game::pl_car())
+				PendingFrame.section = car->OnRoadPlace_5C.roadSectionNum_8;
+		}
 	}
 
 	// Fixes animation rate of certain stage textures (beach waves / street lights...)
@@ -678,6 +1114,7 @@ public:
 			FramelimiterFrequency = double(frequency.QuadPart) / double(1000.f);
 			QueryPerformanceCounter(&counter);
 			FramelimiterPrevCounter = double(counter.QuadPart) / FramelimiterFrequency;
+			PacingWindowStartQpc = counter.QuadPart;
 		}
 
 		constexpr int HookAddr = 0x17C7B;
@@ -2,8 +2,10 @@
 #include <Windows.h>
 #include <shellapi.h>
 #include <winioctl.h>
+#include <dbt.h>
 #include <hidsdi.h>
 
+#include <atomic>
 #include <queue>
 
 #include "hook_mgr.hpp"
@@ -211,12 +213,21 @@ class ControllerHotPlug : public Hook
 {
     const static int DInputInit_CallbackPtr_Addr = 0x3E10;
 
+    // Plugging a pad in fires a burst of notifications, one per interface it
+    // exposes, wait for them to settle (and for DirectInput to catch up)
+    // before enumerating
+    static constexpr UINT EnumerateDelayMs = 250;
+    static constexpr UINT_PTR EnumerateTimerId = 1;
+
 public:
     inline static std::mutex mtx;
-    inline static std::unique_ptr<std::thread> DeviceEnumerationThreadHandle;
     inline static std::vector<GUID> KnownDevices;
     inline static std::queue<DIDEVICEINSTANCE> NewDevices;
 
+    // Set once NewDevices has something in it, so the game tick only has to
+    // check this
+    inline static std::atomic<bool> NewDevicesPending = false;
+
     static BOOL __stdcall DInput_EnumJoysticksCallback(const DIDEVICEINSTANCE* pdidInstance, VOID* pContext)
     {
         std::lock_guard<std::mutex> lock(mtx);
@@ -227,24 +238,75 @@ public:
 
             // Add the new device instance to the queue
             NewDevices.push(*pdidInstance);
+            NewDevicesPending = true;
         }
 
         return DIENUM_CONTINUE;
     }
 
-    static void DeviceEnumerationThread()
+    static LRESULT CALLBACK DeviceNotifyWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+    {
+        switch (msg)
+        {
+        case WM_DEVICECHANGE:
+            // Removal needs nothing from us, the game notices its device is
+            // gone and reacquires it when it comes back
+            if (wParam == DBT_DEVICEARRIVAL)
+                SetTimer(hwnd, EnumerateTimerId, EnumerateDelayMs, nullptr);
+            return TRUE;
+
+        case WM_TIMER:
+            if (wParam == EnumerateTimerId)
+            {
+                KillTimer(hwnd, EnumerateTimerId);
+
+                // Game hasn't set DirectInput up yet, its init will see the device
+                if (Game::DirectInput8())
+                    Game::DirectInput8()->EnumDevices(DI8DEVCLASS_GAMECTRL, DInput_EnumJoysticksCallback, nullptr, DIEDFL_ATTACHEDONLY);
+            }
+            return 0;
+        }
+
+        return DefWindowProcW(hwnd, msg, wParam, lParam);
+    }
+
+    static void DeviceNotificationThread()
     {
 #ifdef _DEBUG
-        SetThreadDescription(GetCurrentThread(), L"DeviceEnumerationThread");
+        SetThreadDescription(GetCurrentThread(), L"DeviceNotificationThread");
 #endif
 
-        while (true)
+        WNDCLASSEXW wc = { sizeof(wc) };
+        wc.lpfnWndProc = DeviceNotifyWndProc;
+        wc.hInstance = GetModuleHandleW(nullptr);
+        wc.lpszClassName = L"OutRun2006Tweaks_DeviceNotify";
+        if (!RegisterClassExW(&wc))
         {
-            if (Game::DirectInput8())
-                Game::DirectInput8()->EnumDevices(DI8DEVCLASS_GAMECTRL, DInput_EnumJoysticksCallback, nullptr, DIEDFL_ATTACHEDONLY);
+            spdlog::error("ControllerHotPlug: RegisterClassExW failed ({})", GetLastError());
+            return;
+        }
+
+        // Message-only, never shown and doesn't get broadcasts meant for the game's window
+        HWND hwnd = CreateWindowExW(0, wc.lpszClassName, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, wc.hInstance, nullptr);
+        if (!hwnd)
+        {
+            spdlog::error("ControllerHotPlug: CreateWindowExW failed ({})", GetLastError());
+            return;
+        }
 
-            std::this_thread::sleep_for(std::chrono::seconds(2)); // Poll every 2 seconds
+        // XInput pads don't always show up as HID, so listen to every interface class
+        DEV_BROADCAST_DEVICEINTERFACE_W filter = { sizeof(filter) };
+        filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+        if (!RegisterDeviceNotificationW(hwnd, &filter, DEVICE_NOTIFY_WINDOW_HANDLE | DEVICE_NOTIFY_ALL_INTERFACE_CLASSES))
+        {
+            spdlog::error("ControllerHotPlug: RegisterDeviceNotificationW failed ({})", GetLastError());
+            DestroyWindow(hwnd);
+            return;
         }
+
+        MSG msg;
+        while (GetMessageW(&msg, nullptr, 0, 0) > 0)
+            DispatchMessageW(&msg);
     }
 
     std::string_view description() override
@@ -268,6 +330,8 @@ public:
         // Patch games controller init code to go through our DInput_EnumJoysticksCallback func, so we can learn GUID of any already connected pads
         Memory::VP::Patch(Module::exe_ptr(DInputInit_CallbackPtr_Addr + 1), DInput_EnumJoysticksCallback);
 
+        std::thread(DeviceNotificationThread).detach();
+
         return true;
     }
 
@@ -277,13 +341,11 @@ ControllerHotPlug ControllerHotPlug::instance;
 
 void DInput_RegisterNewDevices()
 {
-    if (!ControllerHotPlug::DeviceEnumerationThreadHandle)
-    {
-        ControllerHotPlug::DeviceEnumerationThreadHandle = std::make_unique<std::thread>(ControllerHotPlug::DeviceEnumerationThread);
-        ControllerHotPlug::DeviceEnumerationThreadHandle->detach();
-    }
+    if (!ControllerHotPlug::NewDevicesPending.load(std::memory_order_relaxed))
+        return;
 
     std::lock_guard<std::mutex> lock(ControllerHotPlug::mtx);
+    ControllerHotPlug::NewDevicesPending = false;
     while (!ControllerHotPlug::NewDevices.empty())
     {
         DIDEVICEINSTANCE deviceInstance = ControllerHotPlug::NewDevices.front();
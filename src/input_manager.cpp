@@ -13,6 +13,9 @@ namespace Settings
 	Setting<bool> BypassGameSensitivity{ "Controls", "BypassGameSensitivity", false,
 		"Passes steering input to the game directly instead of through its own sensitivity curve, allowing for more "
 		"sensitive controls. Only used when UseNewInput is enabled." };
+	Setting<bool> InputSamplingThread{ "Controls", "InputSamplingThread", false,
+		"Reads the controller 1000 times a second on its own thread instead of once per game tick, so quick taps that land "
+		"between ticks aren't missed and register on the next one. Keyboard is unaffected. Only used when UseNewInput is enabled." };
 }
 
 InputManager InputManager::instance;
@@ -46,6 +49,148 @@ void InputManager::init(HWND hwnd)
 		setupDefaultBindings();
 
 	ensureOverlayBindable();
+
+	if (Settings::InputSamplingThread)
+		InputSampler::Start();
+}
+
+void InputManager::armRecording(const std::filesystem::path& path)
+{
+	stopRecording();
+
+	recordPath_ = path;
+	recordState_ = RecordState::RecordArmed;
+	spdlog::info("InputManager: recording the next race to {}", path.string());
+}
+
+bool InputManager::armReplay(const std::filesystem::path& path, std::string& error)
+{
+	stopRecording();
+
+	if (!recording_.load(path, error))
+	{
+		spdlog::error("InputManager: can't replay {}: {}", path.string(), error);
+		return false;
+	}
+
+	recordPath_ = path;
+	recordState_ = RecordState::ReplayArmed;
+	spdlog::info("InputManager: replaying {} ({} ticks) on the next race", path.string(), recording_.ticks.size());
+	return true;
+}
+
+void InputManager::stopRecording()
+{
+	if (recordState_ == RecordState::Recording || recordState_ == RecordState::Replaying)
+		finishRecording();
+
+	recordState_ = RecordState::Idle;
+}
+
+// Races are told apart by is_in_game, which covers the countdown, pausing and
+// the goal screens, so a race is one recording however it's paused or ends.
+// Called before anything reads this tick's input.
+void InputManager::updateRecordState()
+{
+	const bool inGame = Game::is_in_game();
+	const bool started = inGame && !wasInGame_;
+	const bool ended = !inGame && wasInGame_;
+	wasInGame_ = inGame;
+
+	if (ended && (recordState_ == RecordState::Recording || recordState_ == RecordState::Replaying))
+	{
+		finishRecording();
+		recordState_ = RecordState::Idle;
+		return;
+	}
+
+	if (!started)
+		return;
+
+	const int stage = int(*Game::stg_stage_num);
+
+	if (recordState_ == RecordState::RecordArmed)
+	{
+		recording_ = {};
+		recording_.stage = stage;
+		recording_.initialSwitches = switch_previous;
+		recording_.initialRawButtons = raw_buttons;
+		recordState_ = RecordState::Recording;
+		spdlog::info("InputManager: recording started on stage {}", stage);
+	}
+	else if (recordState_ == RecordState::ReplayArmed)
+	{
+		// Still replayed, the inputs just won't make sense for the track
+		if (recording_.stage != stage)
+			spdlog::warn("InputManager: replaying a stage {} recording on stage {}", recording_.stage, stage);
+
+		switch_previous = recording_.initialSwitches;
+		raw_buttons = recording_.initialRawButtons;
+		replayPosition_ = 0;
+		recordState_ = RecordState::Replaying;
+		spdlog::info("InputManager: replay started on stage {}", stage);
+	}
+}
+
+// Stands in for updateRawDInputState, putting back everything the game reads
+// from us. Past the end of the recording the game sees nothing held.
+void InputManager::replayTick()
+{
+	InputRecording::Tick tick;
+	if (replayPosition_ < recording_.ticks.size())
+		tick = recording_.ticks[replayPosition_];
+	replayPosition_++;
+
+	switch_current = tick.switches;
+	for (int i = 0; i < InputRecording::VolumeCount; i++)
+	{
+		volumes[i].currentValue = tick.volumes[i];
+		volumes[i].previousValue = tick.previousVolumes[i];
+	}
+	lastInputSource_ = tick.keyboard ? InputSourceType::Keyboard : InputSourceType::GamePad;
+
+	raw_pressed = tick.rawButtons & ~raw_buttons;
+	raw_released = raw_buttons & ~tick.rawButtons;
+	raw_buttons = tick.rawButtons;
+
+	applyRawDInputState();
+}
+
+void InputManager::recordTick()
+{
+	InputRecording::Tick tick;
+	tick.switches = switch_current;
+	tick.rawButtons = raw_buttons;
+	for (int i = 0; i < InputRecording::VolumeCount; i++)
+	{
+		tick.volumes[i] = volumes[i].currentValue;
+		tick.previousVolumes[i] = volumes[i].previousValue;
+	}
+	tick.keyboard = lastInputSource_ == InputSourceType::Keyboard;
+
+	recording_.ticks.push_back(tick);
+}
+
+void InputManager::finishRecording()
+{
+	if (recordState_ == RecordState::Recording)
+	{
+		if (recording_.save(recordPath_))
+			spdlog::info("InputManager: saved {} ticks to {}", recording_.ticks.size(), recordPath_.string());
+		else
+			spdlog::error("InputManager: failed to write recording to {}", recordPath_.string());
+	}
+	else if (recordState_ == RecordState::Replaying)
+	{
+		// A race that runs a different length than the recording has diverged
+		// from it somewhere, and its timings aren't comparable
+		const size_t length = recording_.ticks.size();
+		if (replayPosition_ != length)
+			spdlog::warn("InputManager: replay ended after {} of {} ticks, the race didn't follow the recording",
+				replayPosition_, length);
+		else
+			spdlog::info("InputManager: replay finished, {} ticks", length);
+	}
 }
 
 void InputManager_Update()
@@ -54,6 +199,15 @@ void InputManager_Update()
 		InputManager::instance.update();
 }
 
+// Handles controller add/remove and lets SDL refresh its cached key and pad
+// state, without touching anything the game reads. Switch edges are only
+// worked out by update(), so this can run between ticks without eating one.
+void InputManager_PumpEvents()
+{
+	if (Settings::UseNewInput)
+		InputManager::instance.pumpSdlEvents();
+}
+
 // Only meaningful with the new input system; callers fall back to their own
 // hardcoded keys when it is off.
 bool InputManager_ModActionHeld(ModAction action)
@@ -180,6 +334,7 @@ public:
 		Settings::UseNewInput.needs_restart();
 		Settings::UseNewInput.hidden(Settings::UseNewInput); // Unhide if UseNewInput is disabled for some reason, hide if it's enabled
 		Settings::InputBackend.needs_restart();
+		Settings::InputSamplingThread.needs_restart();
 	}
 
 	bool apply() override
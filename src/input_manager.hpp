@@ -11,9 +11,14 @@
 #include "overlay/overlay.hpp"
 
 #include <array>
+#include <climits>
 #include <optional>
+#include <span>
 #include <istream>
 #include "input_names.hpp"
+#include "input_sampler.hpp"
+#include "input_recording.hpp"
+#include "frame_telemetry.hpp"
 
 #include "imgui.h"
 #include <format>
@@ -47,6 +52,15 @@ enum class ModAction
 	Count
 };
 
+enum class RecordState
+{
+	Idle,
+	RecordArmed,
+	Recording,
+	ReplayArmed,
+	Replaying
+};
+
 enum class InputSourceType
 {
 	GamePad,
@@ -111,49 +125,14 @@ struct InputBinding
 		return isKeyboard() ? InputSourceType::Keyboard : InputSourceType::GamePad;
 	}
 
-	float read(SDL_Gamepad* gamepad) const
+	// Raw axis values closer to zero than this read as zero
+	int deadzone() const
 	{
-		float value = 0.0f;
-
-		switch (kind)
-		{
-		case Kind::Key:
-		{
-			const bool* state_array = SDL_GetKeyboardState(nullptr);
-			value = float(state_array[key]);
-			break;
-		}
-		case Kind::PadButton:
-			if (!gamepad)
-				return 0.0f;
-			value = float(SDL_GetGamepadButton(gamepad, button));
-			break;
-		case Kind::PadAxis:
-		{
-			if (!gamepad)
-				return 0.0f;
-
-			Sint16 raw = SDL_GetGamepadAxis(gamepad, axis);
-
-			int deadzone = 0;
-			if (axis == SDL_GAMEPAD_AXIS_LEFTX || axis == SDL_GAMEPAD_AXIS_LEFTY)
-				deadzone = int(StickRange * Settings::SteeringDeadZone);
-			else if (axis == SDL_GAMEPAD_AXIS_RIGHTX || axis == SDL_GAMEPAD_AXIS_RIGHTY)
-				deadzone = int(StickRange * RStickDeadzone);
-			else
-				deadzone = XINPUT_GAMEPAD_TRIGGER_THRESHOLD;
-
-			if (abs(raw) < deadzone)
-				raw = 0;
-
-			value = raw / StickRange;
-			break;
-		}
-		default:
-			return 0.0f;
-		}
-
-		return negate ? -value : value;
+		if (axis == SDL_GAMEPAD_AXIS_LEFTX || axis == SDL_GAMEPAD_AXIS_LEFTY)
+			return int(StickRange * Settings::SteeringDeadZone);
+		if (axis == SDL_GAMEPAD_AXIS_RIGHTX || axis == SDL_GAMEPAD_AXIS_RIGHTY)
+			return int(StickRange * RStickDeadzone);
+		return XINPUT_GAMEPAD_TRIGGER_THRESHOLD;
 	}
 
 	std::string displayName(SDL_GamepadType padType = SDL_GAMEPAD_TYPE_UNKNOWN, bool isSteerAction = false) const
@@ -179,45 +158,196 @@ struct InputBinding
 	}
 };
 
+// What an action's bindings read this update: the one with the highest
+// absolute value, or the first of them on a tie.
+struct BindingResult
+{
+	float value = 0.0f;
+	int order = INT_MAX; // which of the action's bindings it came from
+	bool isAxis = false;
+	InputSourceType source = InputSourceType::GamePad;
+
+	bool won() const { return order != INT_MAX; }
+
+	void consider(float newValue, int newOrder, bool newIsAxis, InputSourceType newSource)
+	{
+		const float magnitude = std::abs(newValue);
+		const float best = std::abs(value);
+		if (magnitude > best || (magnitude == best && magnitude > 0.0f && newOrder < order))
+		{
+			value = newValue;
+			order = newOrder;
+			isAxis = newIsAxis;
+			source = newSource;
+		}
+	}
+};
+
 class InputAction
 {
 	std::vector<InputBinding> bindings_;
 	InputState state_;
 
+	// Bumped by anything that can change any action's bindings, so the
+	// compiled copy InputManager evaluates knows to rebuild. Handing out a
+	// mutable bindings() counts, which means the binding editor rebuilds it
+	// every frame it's open; that's cheap and the game ignores input then.
+	inline static uint32_t revision_ = 0;
+
+public:
+	const InputState& apply(const BindingResult& result)
+	{
+		state_.isAxis = result.isAxis;
+		if (result.won())
+			state_.lastSourceType = result.source;
+
+		state_.update(result.value);
+		return state_;
+	}
+
+	void add(const InputBinding& binding) { bindings_.push_back(binding); revision_++; }
+
+	void clear() { bindings_.clear(); revision_++; }
+
+	std::vector<InputBinding>& bindings() { revision_++; return bindings_; }
+	const std::vector<InputBinding>& bindings() const { return bindings_; }
+
+	static uint32_t revision() { return revision_; }
+
+	const InputState& getState() const { return state_; }
+	void setState(const InputState& state) { this->state_ = state; }
+};
+
+//
+// Every action's bindings, flattened by source with deadzones already worked
+// out, so an update reads each key, button and axis once and never branches on
+// the binding kind. InputAction stays the editable form that the INI and the
+// binding editor work with; this is rebuilt from it when that changes.
+//
+class CompiledBindings
+{
+	struct KeyEntry
+	{
+		SDL_Scancode key;
+		uint16_t slot;
+		uint16_t order;
+		bool negate;
+	};
+
+	// Digital actions latch: they read whether the input was down at any
+	// point since the last update, not just now
+	struct ButtonEntry
+	{
+		SDL_GamepadButton button;
+		uint16_t slot;
+		uint16_t order;
+		bool negate;
+		bool latch;
+	};
+
+	struct AxisEntry
+	{
+		SDL_GamepadAxis axis;
+		uint16_t slot;
+		uint16_t order;
+		bool negate;
+		bool latch;
+		int deadzone;
+	};
+
+	std::vector<KeyEntry> keys_;
+	std::vector<ButtonEntry> buttons_;
+	std::vector<AxisEntry> axes_;
+
+	// Distinct buttons and axes bound to anything, the only ones snapshot reads
+	std::vector<SDL_GamepadButton> usedButtons_;
+	std::vector<SDL_GamepadAxis> usedAxes_;
+
 public:
-	const InputState& update(SDL_Gamepad* primary_pad)
+	void clear()
 	{
-		float maxValue = 0.0f;
-		bool isAxisInput = false;
-		InputSourceType lastSource = state_.lastSourceType;
+		keys_.clear();
+		buttons_.clear();
+		axes_.clear();
+		usedButtons_.clear();
+		usedAxes_.clear();
+	}
 
-		// Read all bindings and take the highest absolute value
-		for (const auto& binding : bindings_)
+	void add(const InputAction& action, size_t slot, bool digital)
+	{
+		const auto& bindings = action.bindings();
+		for (size_t i = 0; i < bindings.size(); i++)
 		{
-			float currentValue = binding.read(primary_pad);
-			if (std::abs(currentValue) > std::abs(maxValue))
+			const InputBinding& binding = bindings[i];
+			switch (binding.kind)
 			{
-				maxValue = currentValue;
-				isAxisInput = binding.isAxis();
-				lastSource = binding.sourceType();
+			case InputBinding::Kind::Key:
+				keys_.push_back({ binding.key, uint16_t(slot), uint16_t(i), binding.negate });
+				break;
+			case InputBinding::Kind::PadButton:
+				if (binding.button < 0 || binding.button >= SDL_GAMEPAD_BUTTON_COUNT)
+					break;
+				buttons_.push_back({ binding.button, uint16_t(slot), uint16_t(i), binding.negate, digital });
+				if (std::find(usedButtons_.begin(), usedButtons_.end(), binding.button) == usedButtons_.end())
+					usedButtons_.push_back(binding.button);
+				break;
+			case InputBinding::Kind::PadAxis:
+				if (binding.axis < 0 || binding.axis >= SDL_GAMEPAD_AXIS_COUNT)
+					break;
+				axes_.push_back({ binding.axis, uint16_t(slot), uint16_t(i), binding.negate, digital, binding.deadzone() });
+				if (std::find(usedAxes_.begin(), usedAxes_.end(), binding.axis) == usedAxes_.end())
+					usedAxes_.push_back(binding.axis);
+				break;
+			default:
+				break;
 			}
 		}
+	}
 
-		state_.lastSourceType = lastSource;
-		state_.isAxis = isAxisInput;
-		state_.update(maxValue);
-		return state_;
+	// Reads the bound buttons and axes from the pad as they are right now,
+	// for when InputSampler isn't running
+	void snapshot(SDL_Gamepad* gamepad, PadState& pad) const
+	{
+		pad.pressTimestamp = 0;
+		for (auto button : usedButtons_)
+			pad.buttons[button] = pad.pressed[button] = SDL_GetGamepadButton(gamepad, button);
+		for (auto axis : usedAxes_)
+			pad.axes[axis] = pad.axisMin[axis] = pad.axisMax[axis] = SDL_GetGamepadAxis(gamepad, axis);
 	}
 
-	void add(const InputBinding& binding) { bindings_.push_back(binding); }
+	// results has one entry per slot given to add. pad is null with no pad connected.
+	void evaluate(const bool* keyboard, const PadState* pad, std::span<BindingResult> results) const
+	{
+		std::fill(results.begin(), results.end(), BindingResult{});
 
-	void clear() { bindings_.clear(); }
+		if (keyboard)
+			for (const auto& entry : keys_)
+			{
+				const float value = keyboard[entry.key] ? 1.0f : 0.0f;
+				results[entry.slot].consider(entry.negate ? -value : value, entry.order, false, InputSourceType::Keyboard);
+			}
 
-	std::vector<InputBinding>& bindings() { return bindings_; }
-	const std::vector<InputBinding>& bindings() const { return bindings_; }
+		if (!pad)
+			return;
 
-	const InputState& getState() const { return state_; }
-	void setState(const InputState& state) { this->state_ = state; }
+		for (const auto& entry : buttons_)
+		{
+			const bool down = entry.latch ? pad->pressed[entry.button] : pad->buttons[entry.button];
+			const float value = down ? 1.0f : 0.0f;
+			results[entry.slot].consider(entry.negate ? -value : value, entry.order, false, InputSourceType::GamePad);
+		}
+
+		for (const auto& entry : axes_)
+		{
+			// Latched, the furthest it went in the direction that presses it
+			Sint16 raw = pad->axes[entry.axis];
+			if (entry.latch)
+				raw = entry.negate ? pad->axisMin[entry.axis] : pad->axisMax[entry.axis];
+
+			const float value = abs(raw) < entry.deadzone ? 0.0f : raw / InputBinding::StickRange;
+			results[entry.slot].consider(entry.negate ? -value : value, entry.order, true, InputSourceType::GamePad);
+		}
+	}
 };
 
 // ReadSwitch translates the raw DirectInput button mask into the SwitchId bits
@@ -263,6 +393,24 @@ private:
 	std::array<InputAction, size_t(SwitchId::Count)> switchBindings;
 	std::array<InputAction, size_t(ModAction::Count)> modBindings;
 
+	// The three tables above as one, evaluated in a single pass. Slots run
+	// volumes, then switches, then mod actions.
+	static constexpr size_t SwitchSlots = size_t(ADChannel::Count);
+	static constexpr size_t ModSlots = SwitchSlots + size_t(SwitchId::Count);
+	static constexpr size_t BindingSlots = ModSlots + size_t(ModAction::Count);
+
+	CompiledBindings compiled;
+	uint32_t compiledRevision = UINT32_MAX;
+	float compiledDeadzone = -1.0f;
+	std::array<BindingResult, BindingSlots> bindingResults;
+	PadState padState;
+
+	// QPC of the last evaluateBindings, and of the pad press it saw first
+	// (the read time if the sampler didn't see one), while Telemetry is
+	// measuring input latency.
+	int64_t inputReadQpc = 0;
+	int64_t inputPressQpc = 0;
+
 	std::mutex mtx;
 	std::vector<SDL_Gamepad*> controllers;
 	int primaryControllerIndex = -1;
@@ -298,6 +446,13 @@ private:
 	bool suppressGameUntilRelease = false;
 	InputSourceType lastInputSource_ = InputSourceType::GamePad;
 
+	// Race recording/replay, see updateRecordState()
+	RecordState recordState_ = RecordState::Idle;
+	InputRecording recording_;
+	std::filesystem::path recordPath_;
+	size_t replayPosition_ = 0;
+	bool wasInGame_ = false;
+
 private:
 	static inline const std::string volumeNames[] = {
 		"Steering",
@@ -439,6 +594,22 @@ public:
 			SDL_CloseGamepad(controller);
 	}
 
+	// For threads other than the game's: runs fn on the primary pad, holding
+	// the lock that keeps a removal from closing it meanwhile. False if there
+	// isn't one.
+	template <typename Fn>
+	bool withPrimaryGamepad(Fn&& fn)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		auto* pad = getPrimaryGamepad();
+		if (!pad)
+			return false;
+
+		fn(pad);
+		return true;
+	}
+
 	SDL_Gamepad* getPrimaryGamepad()
 	{
 		if (primaryControllerIndex < 0)
@@ -822,14 +993,56 @@ public:
 			}
 	}
 
+	// Rebuilds the compiled bindings if the tables or the steering deadzone
+	// changed since, then reads every binding at once. The pad comes from
+	// InputSampler when that's running, otherwise it's read now.
+	void evaluateBindings(SDL_Gamepad* gamepad)
+	{
+		if (compiledRevision != InputAction::revision() || compiledDeadzone != Settings::SteeringDeadZone) [[unlikely]]
+		{
+			compiled.clear();
+			for (size_t i = 0; i < volumeBindings.size(); ++i)
+				compiled.add(volumeBindings[i], i, false);
+			for (size_t i = 0; i < switchBindings.size(); ++i)
+				compiled.add(switchBindings[i], SwitchSlots + i, true);
+			for (size_t i = 0; i < modBindings.size(); ++i)
+				compiled.add(modBindings[i], ModSlots + i, true);
+
+			compiledRevision = InputAction::revision();
+			compiledDeadzone = Settings::SteeringDeadZone;
+		}
+
+		const PadState* pad = nullptr;
+		if (InputSampler::Running())
+		{
+			if (InputSampler::Consume(padState))
+				pad = &padState;
+		}
+		else if (gamepad)
+		{
+			compiled.snapshot(gamepad, padState);
+			pad = &padState;
+		}
+
+		compiled.evaluate(SDL_GetKeyboardState(nullptr), pad, bindingResults);
+
+		if (Telemetry::LatencyActive()) [[unlikely]]
+		{
+			LARGE_INTEGER qpc;
+			QueryPerformanceCounter(&qpc);
+			inputReadQpc = qpc.QuadPart;
+			inputPressQpc = pad && pad->pressTimestamp ? pad->pressTimestamp : inputReadQpc;
+		}
+	}
+
 	// Reads every volume binding into the cache the game later queries.
 	// Skipped entirely while the binding dialog is up, so a stick being waved
 	// around to pick a bind doesn't steer the car.
-	void updateVolumes(SDL_Gamepad* gamepad)
+	void updateVolumes()
 	{
 		for (size_t i = 0; i < volumeBindings.size(); ++i)
 		{
-			auto& vol = volumeBindings[i].update(gamepad);
+			auto& vol = volumeBindings[i].apply(bindingResults[i]);
 			if (Overlay::IsBindingDialogActive || Overlay::IsActive) [[unlikely]]
 				continue;
 
@@ -848,12 +1061,12 @@ public:
 	}
 
 	// Collapses the switch bindings into a bitmask, one bit per SwitchId.
-	uint32_t readSwitchMask(SDL_Gamepad* gamepad)
+	uint32_t readSwitchMask()
 	{
 		uint32_t mask = 0;
 		for (size_t i = 0; i < switchBindings.size(); ++i)
 		{
-			auto& switchState = switchBindings[i].update(gamepad);
+			auto& switchState = switchBindings[i].apply(bindingResults[SwitchSlots + i]);
 			if (switchState.isPressed())
 			{
 				mask |= (1 << i);
@@ -871,6 +1084,8 @@ public:
 
 		switch_previous = switch_current;
 
+		updateRecordState();
+
 		// Whatever opened the binding dialog (or started a listen) is still
 		// physically held down right now. Passing that press on would instantly
 		// re-trigger whatever we just opened, so latch a suppression flag and
@@ -880,8 +1095,9 @@ public:
 		if (Overlay::IsBindingDialogActive)
 			suppressGameUntilRelease = true;
 
-		updateVolumes(gamepad);
-		switch_current = readSwitchMask(gamepad);
+		evaluateBindings(gamepad);
+		updateVolumes();
+		switch_current = readSwitchMask();
 
 		// Everything released - safe to start passing input on again.
 		if (switch_current == 0) [[likely]]
@@ -904,22 +1120,38 @@ public:
 		if (suppressGameUntilRelease || Overlay::IsBindingDialogActive || Overlay::IsActive) [[unlikely]]
 			switch_current = 0;
 
-		updateModActions(gamepad);
+		updateModActions();
+
+		if (recordState_ == RecordState::Replaying) [[unlikely]]
+			replayTick();
+		else
+			updateRawDInputState();
+
+		if (recordState_ == RecordState::Recording) [[unlikely]]
+			recordTick();
 
-		updateRawDInputState();
+		// A new press is about to reach the game. Replayed ones were never
+		// physically pressed, so they count from the read.
+		if (Telemetry::LatencyActive() && ((switch_current & ~switch_previous) || raw_pressed)) [[unlikely]]
+			Telemetry::InputPressed(recordState_ == RecordState::Replaying ? inputReadQpc : inputPressQpc, inputReadQpc);
 	}
 
+	void updateRecordState();
+	void replayTick();
+	void recordTick();
+	void finishRecording();
+
 	// Mod actions take the overlay's suppression but not the game's, so the
 	// overlay toggle can still close the overlay. The binding dialog owns every
 	// input while it is up, so nothing fires under it. States keep updating
 	// regardless, so a key held across the dialog closing reads as held rather
 	// than newly pressed.
-	void updateModActions(SDL_Gamepad* gamepad)
+	void updateModActions()
 	{
 		modActionsDeaf = suppressOverlayUntilRelease || Overlay::IsBindingDialogActive;
 
 		for (size_t i = 0; i < modBindings.size(); ++i)
-			modStates[i] = modBindings[i].update(gamepad);
+			modStates[i] = modBindings[i].apply(bindingResults[ModSlots + i]);
 	}
 
 	// Rebuilds the raw DirectInput masks from the bindings. Called once per
@@ -983,7 +1215,8 @@ public:
 	// labels depend on which pad is connected.
 	std::string modActionDisplayName(ModAction action)
 	{
-		const auto& bindings = modBindings[size_t(action)].bindings();
+		const InputAction& bound = modBindings[size_t(action)];
+		const auto& bindings = bound.bindings();
 		if (bindings.empty())
 			return "(unbound)";
 
@@ -1022,14 +1255,26 @@ public:
 	InputAction& modAction(ModAction action) { return modBindings[size_t(action)]; }
 	static const std::string& modActionName(ModAction action) { return modNames[size_t(action)]; }
 
+	// Called from the rumble dispatch thread. mtx is only held long enough to
+	// find the pad, as the sampler and hotplug take it too and the rumble is a
+	// blocking write to the device. SDL's joystick lock keeps the pad from
+	// being closed under it by a removal on the game thread.
 	void setVibration(WORD left, WORD right)
 	{
-		auto* controller = getPrimaryGamepad();
-		if (!controller)
-			return;
+		SDL_JoystickID id;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
 
-		std::lock_guard<std::mutex> lock(mtx);
-		SDL_RumbleGamepad(controller, left, right, 1000);
+			auto* controller = getPrimaryGamepad();
+			if (!controller)
+				return;
+			id = SDL_GetGamepadID(controller);
+		}
+
+		SDL_LockJoysticks();
+		auto* controller = SDL_GetGamepadFromID(id);
+		if (controller)
+			SDL_RumbleGamepad(controller, left, right, 1000);
 
 		// TODO: SDL_RumbleGamepadTriggers doesn't appear to work with any backend?
 		// Disabling this code for now, we'll rely on the old ImpulseVibration / DetourDeviceIoControl method instead.
@@ -1053,6 +1298,7 @@ public:
 			SDL_RumbleGamepadTriggers(controller, Uint16(ceil(impulseLeft)), Uint16(ceil(impulseRight)), 1000);
 		}
 #endif
+		SDL_UnlockJoysticks();
 	}
 
 	// Add sources to bindings
@@ -1103,6 +1349,21 @@ public:
 
 	InputSourceType lastInputSource() { return lastInputSource_; }
 
+	// Recording a race's input, or driving one from a recording, for benchmark
+	// runs that have to be repeatable. Either is armed ahead of time and starts
+	// on the tick the next race does, then ends with the race, so a replay
+	// lines up tick for tick with the recording it came from.
+	void armRecording(const std::filesystem::path& path);
+	bool armReplay(const std::filesystem::path& path, std::string& error);
+
+	// Disarms, or ends the current race's recording/replay early. A recording
+	// cut short is still saved.
+	void stopRecording();
+
+	RecordState recordState() const { return recordState_; }
+	const InputRecording& recording() const { return recording_; }
+	size_t replayPosition() const { return replayPosition_; }
+
 	//
 	// Handlers for games original input functions
 	//
@@ -1142,6 +1403,7 @@ public:
 constexpr uint32_t StartSwitchMask = 1 << int(SwitchId::Start);
 
 void InputManager_Update();
+void InputManager_PumpEvents();
 bool InputManager_ModActionHeld(ModAction action);
 std::string InputManager_ModActionDisplayName(ModAction action);
 void InputManager_SetVibration(WORD left, WORD right);
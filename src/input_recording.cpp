@@ -0,0 +1,256 @@
+#include "input_recording.hpp"
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// Layout: the header, the ticks, then an FNV-1a hash of everything before
+	// it. Each tick is a uint16 mask of the fields that differ from the tick
+	// before (the first from a default Tick), then those fields in mask order.
+	// Everything little-endian, like every machine this or the tool runs on.
+	constexpr char FileMagic[4] = { 'O', 'R', 'I', 'R' };
+	constexpr uint32_t FileVersion = 1;
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t tickRate;
+		int32_t stage;
+		uint64_t seed;
+		uint32_t tickCount;
+		uint32_t initialSwitches;
+		uint32_t initialRawButtons;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(FileHeader) == 40);
+
+	enum FieldBits : uint16_t
+	{
+		FieldSwitches = 1 << 0,
+		FieldRawButtons = 1 << 1,
+		FieldKeyboard = 1 << 2, // no payload, flips the flag
+		FieldVolume0 = 1 << 3,
+		FieldPreviousVolume0 = FieldVolume0 << InputRecording::VolumeCount,
+		FieldAll = (FieldPreviousVolume0 << InputRecording::VolumeCount) - 1
+	};
+
+	uint64_t fnv1a(const uint8_t* data, size_t size)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// Bitwise, so replaying puts back exactly the float that was recorded
+	bool same(float a, float b)
+	{
+		return memcmp(&a, &b, sizeof(float)) == 0;
+	}
+
+	template <typename T>
+	void put(std::vector<uint8_t>& data, const T& value)
+	{
+		const size_t at = data.size();
+		data.resize(at + sizeof(T));
+		memcpy(data.data() + at, &value, sizeof(T));
+	}
+
+	template <typename T>
+	bool take(const uint8_t*& cur, const uint8_t* end, T& value)
+	{
+		if (size_t(end - cur) < sizeof(T))
+			return false;
+
+		memcpy(&value, cur, sizeof(T));
+		cur += sizeof(T);
+		return true;
+	}
+}
+
+std::vector<uint8_t> InputRecording::serialize() const
+{
+	FileHeader header{};
+	memcpy(header.magic, FileMagic, sizeof(header.magic));
+	header.version = FileVersion;
+	header.tickRate = TickRate;
+	header.stage = stage;
+	header.seed = seed;
+	header.tickCount = uint32_t(ticks.size());
+	header.initialSwitches = initialSwitches;
+	header.initialRawButtons = initialRawButtons;
+
+	std::vector<uint8_t> data;
+	data.reserve(sizeof(header) + ticks.size() * 8 + sizeof(uint64_t));
+	put(data, header);
+
+	Tick last;
+	for (const Tick& tick : ticks)
+	{
+		uint16_t fields = 0;
+		if (tick.switches != last.switches)
+			fields |= FieldSwitches;
+		if (tick.rawButtons != last.rawButtons)
+			fields |= FieldRawButtons;
+		if (tick.keyboard != last.keyboard)
+			fields |= FieldKeyboard;
+		for (int i = 0; i < VolumeCount; i++)
+		{
+			if (!same(tick.volumes[i], last.volumes[i]))
+				fields |= FieldVolume0 << i;
+			if (!same(tick.previousVolumes[i], last.previousVolumes[i]))
+				fields |= FieldPreviousVolume0 << i;
+		}
+
+		put(data, fields);
+		if (fields & FieldSwitches)
+			put(data, tick.switches);
+		if (fields & FieldRawButtons)
+			put(data, tick.rawButtons);
+		for (int i = 0; i < VolumeCount; i++)
+			if (fields & (FieldVolume0 << i))
+				put(data, tick.volumes[i]);
+		for (int i = 0; i < VolumeCount; i++)
+			if (fields & (FieldPreviousVolume0 << i))
+				put(data, tick.previousVolumes[i]);
+
+		last = tick;
+	}
+
+	put(data, fnv1a(data.data(), data.size()));
+	return data;
+}
+
+bool InputRecording::parse(const uint8_t* data, size_t size, std::string& error)
+{
+	*this = {};
+
+	FileHeader header;
+	if (size < sizeof(header) + sizeof(uint64_t))
+	{
+		error = "file too short";
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, FileMagic, sizeof(header.magic)) != 0)
+	{
+		error = "not an input recording";
+		return false;
+	}
+	if (header.version != FileVersion)
+	{
+		error = "unsupported version " + std::to_string(header.version);
+		return false;
+	}
+	if (header.tickRate != TickRate)
+	{
+		error = "recorded at " + std::to_string(header.tickRate) + " ticks per second, expected " + std::to_string(TickRate);
+		return false;
+	}
+
+	const size_t bodyEnd = size - sizeof(uint64_t);
+	uint64_t checksum;
+	memcpy(&checksum, data + bodyEnd, sizeof(checksum));
+	if (checksum != fnv1a(data, bodyEnd))
+	{
+		error = "checksum mismatch";
+		return false;
+	}
+
+	// Every tick takes at least its mask, so a count that couldn't fit is
+	// caught before reserving for it
+	const uint8_t* cur = data + sizeof(header);
+	const uint8_t* end = data + bodyEnd;
+	if (header.tickCount > size_t(end - cur) / sizeof(uint16_t))
+	{
+		error = "tick count " + std::to_string(header.tickCount) + " doesn't fit the file";
+		return false;
+	}
+
+	std::vector<Tick> parsed;
+	parsed.reserve(header.tickCount);
+
+	Tick tick;
+	for (uint32_t t = 0; t < header.tickCount; t++)
+	{
+		uint16_t fields = 0;
+		bool ok = take(cur, end, fields);
+		if (ok && (fields & ~FieldAll))
+		{
+			error = "unknown fields at tick " + std::to_string(t);
+			return false;
+		}
+
+		if (ok && (fields & FieldSwitches))
+			ok = take(cur, end, tick.switches);
+		if (ok && (fields & FieldRawButtons))
+			ok = take(cur, end, tick.rawButtons);
+		if (fields & FieldKeyboard)
+			tick.keyboard = !tick.keyboard;
+		for (int i = 0; ok && i < VolumeCount; i++)
+			if (fields & (FieldVolume0 << i))
+				ok = take(cur, end, tick.volumes[i]);
+		for (int i = 0; ok && i < VolumeCount; i++)
+			if (fields & (FieldPreviousVolume0 << i))
+				ok = take(cur, end, tick.previousVolumes[i]);
+
+		if (!ok)
+		{
+			error = "truncated at tick " + std::to_string(t);
+			return false;
+		}
+
+		parsed.push_back(tick);
+	}
+
+	if (cur != end)
+	{
+		error = std::to_string(end - cur) + " bytes left over after the last tick";
+		return false;
+	}
+
+	stage = header.stage;
+	seed = header.seed;
+	initialSwitches = header.initialSwitches;
+	initialRawButtons = header.initialRawButtons;
+	ticks = std::move(parsed);
+	return true;
+}
+
+bool InputRecording::save(const std::filesystem::path& path) const
+{
+	const auto data = serialize();
+
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write((const char*)data.data(), data.size());
+	return file.good();
+}
+
+bool InputRecording::load(const std::filesystem::path& path, std::string& error)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		error = "couldn't open file";
+		return false;
+	}
+
+	const auto size = size_t(file.tellg());
+	std::vector<uint8_t> data(size);
+	file.seekg(0);
+	if (!file.read((char*)data.data(), size))
+	{
+		error = "couldn't read file";
+		return false;
+	}
+
+	return parse(data.data(), data.size(), error);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Per-tick input as InputManager hands it to the game, captured over one race
+// so the same race can be driven again exactly, for benchmark laps that need
+// to be repeatable from build to build.
+//
+// Each tick holds what the game reads back: the switch mask, the three
+// volumes after the steering curve, the raw DirectInput button mask, and
+// whether the last switch came from the keyboard (which some menus check).
+// Consecutive ticks rarely differ in more than a field or two, so a tick is
+// stored as a mask of the fields that changed followed by just those.
+//
+// Nothing here touches Windows or the game, so the inputrec tool builds it as
+// well.
+class InputRecording
+{
+public:
+	static constexpr uint32_t TickRate = 60;
+	static constexpr int VolumeCount = 3; // ADChannel::Count
+
+	struct Tick
+	{
+		uint32_t switches = 0;
+		uint32_t rawButtons = 0;
+		float volumes[VolumeCount] = {};
+		float previousVolumes[VolumeCount] = {};
+		bool keyboard = false;
+
+		bool operator==(const Tick&) const = default;
+	};
+
+	int32_t stage = -1;
+
+	// The switch and raw button masks the tick before the first, so presses
+	// on the first tick replay as presses rather than holds.
+	uint32_t initialSwitches = 0;
+	uint32_t initialRawButtons = 0;
+
+	// No RNG seed address is known yet, so this is written as 0 for now. It's
+	// in the header so recordings made once one is don't need a new version.
+	uint64_t seed = 0;
+
+	std::vector<Tick> ticks;
+
+	std::vector<uint8_t> serialize() const;
+
+	// Replaces the contents with the file's. On failure error says why and the
+	// recording is left empty.
+	bool parse(const uint8_t* data, size_t size, std::string& error);
+
+	bool save(const std::filesystem::path& path) const;
+	bool load(const std::filesystem::path& path, std::string& error);
+};
@@ -0,0 +1,180 @@
+#include "input_manager.hpp"
+#include "input_sampler.hpp"
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace InputSampler
+{
+	// A seqlock per slot. seq is odd while the slot is being written and
+	// 2 * (index + 1) once sample `index` is in it, so a reader can tell a
+	// slot that was lapped or is mid-write from the sample it wanted. The
+	// sample is held as atomic words so neither side races on it.
+	constexpr size_t SampleWords = (sizeof(Sample) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	struct Slot
+	{
+		std::atomic<uint64_t> seq = 0;
+		std::array<std::atomic<uint64_t>, SampleWords> words{};
+	};
+
+	static std::array<Slot, RingSize> Ring;
+	static std::atomic<uint64_t> Written = 0; // samples ever written, the newest is Written - 1
+	static std::atomic<bool> Started = false;
+
+	// Only read by Consume, which the game thread alone calls
+	static uint64_t Consumed = 0;
+
+	// The consumer stays at least this far behind the writer, so it rarely
+	// finds a slot lapped while reading it
+	constexpr uint64_t RingSlack = 16;
+
+	static void WriteSlot(uint64_t index, const Sample& sample)
+	{
+		uint64_t words[SampleWords] = {};
+		memcpy(words, &sample, sizeof(sample));
+
+		Slot& slot = Ring[index % RingSize];
+		slot.seq.store(index * 2 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < SampleWords; i++)
+			slot.words[i].store(words[i], std::memory_order_relaxed);
+		slot.seq.store(index * 2 + 2, std::memory_order_release);
+	}
+
+	// False if the slot no longer holds sample `index`, or is being rewritten
+	static bool ReadSlot(uint64_t index, Sample& sample)
+	{
+		const Slot& slot = Ring[index % RingSize];
+		const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+		if (seq != index * 2 + 2)
+			return false;
+
+		uint64_t words[SampleWords];
+		for (size_t i = 0; i < SampleWords; i++)
+			words[i] = slot.words[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) != seq)
+			return false;
+
+		memcpy(&sample, words, sizeof(sample));
+		return true;
+	}
+
+	static void ReadPad(SDL_Gamepad* pad, Sample& sample)
+	{
+		for (int button = 0; button < SDL_GAMEPAD_BUTTON_COUNT; button++)
+			if (SDL_GetGamepadButton(pad, SDL_GamepadButton(button)))
+				sample.buttons |= 1u << button;
+
+		for (int axis = 0; axis < SDL_GAMEPAD_AXIS_COUNT; axis++)
+			sample.axes[axis] = SDL_GetGamepadAxis(pad, SDL_GamepadAxis(axis));
+	}
+
+	static void SampleThread()
+	{
+#ifdef _DEBUG
+		SetThreadDescription(GetCurrentThread(), L"InputSampleThread");
+#endif
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
+
+		// Periodic, so time spent reading doesn't push every later sample back
+		HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (timer)
+		{
+			LARGE_INTEGER due;
+			due.QuadPart = -10'000'000 / RateHz;
+			SetWaitableTimerEx(timer, &due, 1000 / RateHz, NULL, NULL, NULL, 0);
+		}
+		else
+			spdlog::warn("InputSampler: no high resolution timer, falling back to Sleep");
+
+		for (;;)
+		{
+			if (timer)
+				WaitForSingleObject(timer, INFINITE);
+			else
+				Sleep(1);
+
+			// Thread safe, SDL takes its joystick lock
+			SDL_UpdateGamepads();
+
+			Sample sample;
+			LARGE_INTEGER qpc;
+			QueryPerformanceCounter(&qpc);
+			sample.timestamp = qpc.QuadPart;
+			sample.connected = InputManager::instance.withPrimaryGamepad([&sample](SDL_Gamepad* pad) { ReadPad(pad, sample); });
+
+			const uint64_t index = Written.load(std::memory_order_relaxed);
+			WriteSlot(index, sample);
+			Written.store(index + 1, std::memory_order_release);
+		}
+	}
+
+	void Start()
+	{
+		if (Started.exchange(true))
+			return;
+
+		spdlog::info("InputSampler: sampling gamepad at {}Hz", RateHz);
+
+		std::thread(SampleThread).detach();
+	}
+
+	bool Running()
+	{
+		return Started;
+	}
+
+	bool Consume(PadState& state)
+	{
+		const uint64_t written = Written.load(std::memory_order_acquire);
+		if (!written)
+			return false;
+
+		// Nothing new since last time, the newest sample still stands
+		const bool fresh = Consumed < written;
+		uint64_t first = fresh ? Consumed : written - 1;
+		if (written - first > RingSize - RingSlack)
+			first = written - (RingSize - RingSlack);
+		Consumed = written;
+
+		Sample newest;
+		if (!ReadSlot(written - 1, newest) || !newest.connected)
+			return false;
+
+		state.pressTimestamp = 0;
+		state.axes = newest.axes;
+		state.axisMin = newest.axes;
+		state.axisMax = newest.axes;
+
+		// A sample that's been lapped by the time it's read is skipped
+		uint32_t pressed = 0;
+		Sample sample;
+		uint32_t previous = first && ReadSlot(first - 1, sample) ? sample.buttons : 0;
+		for (uint64_t i = first; i < written; i++)
+		{
+			if (!ReadSlot(i, sample) || !sample.connected)
+				continue;
+
+			pressed |= sample.buttons;
+			if (fresh && !state.pressTimestamp && (sample.buttons & ~previous))
+				state.pressTimestamp = sample.timestamp;
+			previous = sample.buttons;
+
+			for (int axis = 0; axis < SDL_GAMEPAD_AXIS_COUNT; axis++)
+			{
+				state.axisMin[axis] = min(state.axisMin[axis], sample.axes[axis]);
+				state.axisMax[axis] = max(state.axisMax[axis], sample.axes[axis]);
+			}
+		}
+
+		for (int button = 0; button < SDL_GAMEPAD_BUTTON_COUNT; button++)
+		{
+			state.buttons[button] = (newest.buttons >> button) & 1;
+			state.pressed[button] = (pressed >> button) & 1;
+		}
+
+		return true;
+	}
+}
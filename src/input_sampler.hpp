@@ -0,0 +1,52 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+// Gamepad state the bindings are evaluated against for one InputManager
+// update. Digital actions read the pressed/extreme fields so a tap between
+// two updates still counts; analog ones read the latest values.
+struct PadState
+{
+	std::array<bool, SDL_GAMEPAD_BUTTON_COUNT> buttons{}; // as of the newest sample
+	std::array<bool, SDL_GAMEPAD_BUTTON_COUNT> pressed{}; // down in any sample since the last update
+	std::array<Sint16, SDL_GAMEPAD_AXIS_COUNT> axes{};
+	std::array<Sint16, SDL_GAMEPAD_AXIS_COUNT> axisMin{}; // extremes since the last update
+	std::array<Sint16, SDL_GAMEPAD_AXIS_COUNT> axisMax{};
+
+	// QPC of the first sample since the last update where a button went down,
+	// 0 if none did
+	int64_t pressTimestamp = 0;
+};
+
+// Optional thread that reads the primary gamepad at 1kHz into a timestamped
+// ring, instead of the game tick reading it once every 60th of a second.
+// Each update then folds in everything since the last one, so a press shorter
+// than a tick isn't lost and lands on the first tick after it.
+//
+// Only the pad is sampled here. SDL fills in keyboard state from the game
+// window's messages, which only the game thread pumps.
+namespace InputSampler
+{
+	constexpr unsigned RateHz = 1000;
+	constexpr size_t RingSize = 1024; // a second's worth
+
+	struct Sample
+	{
+		int64_t timestamp = 0; // QPC
+		bool connected = false;
+		uint32_t buttons = 0;  // bit per SDL_GamepadButton
+		std::array<Sint16, SDL_GAMEPAD_AXIS_COUNT> axes{};
+	};
+	static_assert(SDL_GAMEPAD_BUTTON_COUNT <= 32);
+	static_assert(std::is_trivially_copyable_v<Sample>);
+
+	void Start();
+	bool Running();
+
+	// Folds every sample since the previous call into state, or repeats the
+	// newest if there are none. False if there's no pad to read.
+	bool Consume(PadState& state);
+}
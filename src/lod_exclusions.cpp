@@ -0,0 +1,336 @@
+#include "lod_exclusions.hpp"
+#include <charconv>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// Compiled layout: the header, then one Entry per excluded node ordered by
+	// stage, object and node. Everything little-endian, like every machine
+	// this or the tool runs on.
+	constexpr char CompiledMagic[4] = { 'O', 'R', 'L', 'X' };
+	constexpr uint32_t CompiledVersion = 2;
+
+	struct CompiledHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceSize;
+		uint64_t sourceHash;
+		uint32_t skipQuickSort[LodExclusions::MaxStages / 32];
+		uint32_t count;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(CompiledHeader) == 48);
+
+	struct CompiledEntry
+	{
+		uint8_t stage;
+		uint8_t object;
+		uint16_t node;
+	};
+	static_assert(sizeof(CompiledEntry) == 4);
+
+	std::string_view trim(std::string_view text)
+	{
+		const auto first = text.find_first_not_of(" \t\r");
+		if (first == std::string_view::npos)
+			return {};
+		const auto last = text.find_last_not_of(" \t\r");
+		return text.substr(first, last - first + 1);
+	}
+
+	// Accepts what std::stol with base 0 did: 0x for hex, a leading 0 for
+	// octal, decimal otherwise.
+	bool parse_int(std::string_view text, int& value)
+	{
+		text = trim(text);
+
+		int base = 10;
+		if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+		{
+			base = 16;
+			text.remove_prefix(2);
+		}
+		else if (text.size() > 1 && text[0] == '0')
+		{
+			base = 8;
+			text.remove_prefix(1);
+		}
+
+		const auto result = std::from_chars(text.data(), text.data() + text.size(), value, base);
+		return result.ec == std::errc() && result.ptr == text.data() + text.size();
+	}
+
+	// Stage number out of a section name like "Stage 12"
+	int section_number(std::string_view section)
+	{
+		int number = -1;
+		const auto pos = section.find_first_of("0123456789");
+		if (pos == std::string_view::npos)
+			return -1;
+
+		const auto result = std::from_chars(section.data() + pos, section.data() + section.size(), number);
+		return result.ec == std::errc() ? number : -1;
+	}
+
+	std::string line_warning(int lineNum, const std::string& message)
+	{
+		return "line " + std::to_string(lineNum) + ": " + message;
+	}
+
+	bool parse_bool(std::string_view text, bool& value)
+	{
+		std::string lower(trim(text));
+		for (auto& c : lower)
+			c = char(tolower((unsigned char)c));
+
+		if (lower == "1" || lower == "true" || lower == "yes" || lower == "on")
+			value = true;
+		else if (lower == "0" || lower == "false" || lower == "no" || lower == "off")
+			value = false;
+		else
+			return false;
+		return true;
+	}
+}
+
+// FNV-1a over the bytes. The INI is a few tens of KB, so hashing it costs
+// next to nothing beside parsing it.
+bool LodExclusions::stamp_of(const std::filesystem::path& path, SourceStamp& stamp)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (file.bad())
+		return false;
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char c : text)
+	{
+		hash ^= uint8_t(c);
+		hash *= 0x100000001b3ull;
+	}
+
+	stamp.size = text.size();
+	stamp.hash = hash;
+	return true;
+}
+
+std::filesystem::path LodExclusions::compiled_path(const std::filesystem::path& iniPath)
+{
+	auto path = iniPath;
+	path.replace_extension(".bin");
+	return path;
+}
+
+// Same rules inih applied for this file: ; or # starts a comment line, ; after
+// whitespace starts an inline one, and keys split from values on = or :.
+bool LodExclusions::parse_ini(std::string_view text, std::vector<std::string>& warnings)
+{
+	clear();
+
+	if (text.size() >= 3 && memcmp(text.data(), "\xEF\xBB\xBF", 3) == 0)
+		text.remove_prefix(3);
+
+	int stage = -1;
+	bool skipSection = true;
+	int lineNum = 0;
+
+	while (!text.empty())
+	{
+		const auto eol = text.find('\n');
+		std::string_view line = text.substr(0, eol);
+		text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+		lineNum++;
+
+		line = trim(line);
+		if (line.empty() || line[0] == ';' || line[0] == '#')
+			continue;
+
+		for (size_t i = 1; i < line.size(); i++)
+			if (line[i] == ';' && (line[i - 1] == ' ' || line[i - 1] == '\t'))
+			{
+				line = trim(line.substr(0, i));
+				break;
+			}
+
+		if (line[0] == '[')
+		{
+			const auto end = line.find(']');
+			if (end == std::string_view::npos)
+			{
+				warnings.push_back(line_warning(lineNum, "unterminated section \"" + std::string(line) + "\""));
+				skipSection = true;
+				continue;
+			}
+
+			const auto section = line.substr(1, end - 1);
+			stage = section_number(section);
+			skipSection = stage < 0 || stage >= MaxStages;
+			if (skipSection)
+				warnings.push_back(line_warning(lineNum, "invalid stage section \"" + std::string(section) + "\", skipping..."));
+			continue;
+		}
+
+		if (skipSection)
+			continue;
+
+		const auto separator = line.find_first_of("=:");
+		if (separator == std::string_view::npos)
+		{
+			warnings.push_back(line_warning(lineNum, "expected key = value"));
+			continue;
+		}
+
+		const auto key = trim(line.substr(0, separator));
+		const auto value = trim(line.substr(separator + 1));
+
+		if (key == "SkipQuickSort")
+		{
+			bool skip = false;
+			if (parse_bool(value, skip))
+				skipQuickSort_[stage] = skip;
+			else
+				warnings.push_back(line_warning(lineNum, "invalid SkipQuickSort value \"" + std::string(value) + "\""));
+			continue;
+		}
+
+		int object = -1;
+		if (!parse_int(key, object) || object < 0 || object >= MaxObjects)
+		{
+			warnings.push_back(line_warning(lineNum, "invalid object number \"" + std::string(key) + "\", skipping..."));
+			continue;
+		}
+
+		std::string_view nodes = value;
+		while (!nodes.empty())
+		{
+			const auto comma = nodes.find(',');
+			const auto token = trim(nodes.substr(0, comma));
+			nodes.remove_prefix(comma == std::string_view::npos ? nodes.size() : comma + 1);
+
+			if (token.empty())
+				continue;
+
+			int node = -1;
+			if (!parse_int(token, node) || node < 0 || node >= MaxNodes)
+			{
+				warnings.push_back(line_warning(lineNum, "invalid node number \"" + std::string(token) + "\" for object \"" + std::string(key) + "\", skipping..."));
+				continue;
+			}
+
+			set(stage, object, node, true);
+		}
+	}
+
+	return true;
+}
+
+bool LodExclusions::read_ini(const std::filesystem::path& path, std::vector<std::string>& warnings)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return parse_ini(text, warnings);
+}
+
+std::vector<uint8_t> LodExclusions::compile(const SourceStamp& source) const
+{
+	std::vector<CompiledEntry> entries;
+	for (int stage = 0; stage < MaxStages; stage++)
+		for (int object = 0; object < MaxObjects; object++)
+			if (const NodeSet* nodes = find(stage, object))
+				for (int node = 0; node < MaxNodes; node++)
+					if ((*nodes)[node])
+						entries.push_back({ uint8_t(stage), uint8_t(object), uint16_t(node) });
+
+	CompiledHeader header{};
+	memcpy(header.magic, CompiledMagic, sizeof(header.magic));
+	header.version = CompiledVersion;
+	header.sourceSize = source.size;
+	header.sourceHash = source.hash;
+	for (int stage = 0; stage < MaxStages; stage++)
+		if (skipQuickSort_[stage])
+			header.skipQuickSort[stage / 32] |= 1u << (stage % 32);
+	header.count = uint32_t(entries.size());
+
+	std::vector<uint8_t> data(sizeof(header) + entries.size() * sizeof(CompiledEntry));
+	memcpy(data.data(), &header, sizeof(header));
+	if (!entries.empty())
+		memcpy(data.data() + sizeof(header), entries.data(), entries.size() * sizeof(CompiledEntry));
+	return data;
+}
+
+bool LodExclusions::load_compiled(const uint8_t* data, size_t size, SourceStamp& source)
+{
+	CompiledHeader header;
+	if (size < sizeof(header))
+		return false;
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, CompiledMagic, sizeof(header.magic)) != 0 || header.version != CompiledVersion)
+		return false;
+
+	if (size != sizeof(header) + size_t(header.count) * sizeof(CompiledEntry))
+		return false;
+
+	// compile() only writes in-range entries in strictly increasing order, so
+	// anything else is a damaged file. Checked before anything is replaced.
+	std::vector<CompiledEntry> entries(header.count);
+	if (!entries.empty())
+		memcpy(entries.data(), data + sizeof(header), entries.size() * sizeof(CompiledEntry));
+
+	uint32_t previous = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const auto& entry = entries[i];
+		const uint32_t key = (uint32_t(entry.stage) << 24) | (uint32_t(entry.object) << 16) | entry.node;
+		if (entry.stage >= MaxStages || entry.node >= MaxNodes || (i && key <= previous))
+			return false;
+		previous = key;
+	}
+
+	clear();
+
+	for (int stage = 0; stage < MaxStages; stage++)
+		skipQuickSort_[stage] = (header.skipQuickSort[stage / 32] >> (stage % 32)) & 1;
+
+	for (const auto& entry : entries)
+		set(entry.stage, entry.object, entry.node, true);
+
+	source.size = header.sourceSize;
+	source.hash = header.sourceHash;
+	return true;
+}
+
+bool LodExclusions::write_compiled(const std::filesystem::path& path, const SourceStamp& source) const
+{
+	const auto data = compile(source);
+
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write((const char*)data.data(), data.size());
+	return file.good();
+}
+
+bool LodExclusions::read_compiled(const std::filesystem::path& path, SourceStamp& source)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	const auto size = size_t(file.tellg());
+	std::vector<uint8_t> data(size);
+	file.seekg(0);
+	if (!file.read((char*)data.data(), size))
+		return false;
+
+	return load_compiled(data.data(), data.size(), source);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Culling nodes DrawDistanceIncrease should leave out, per stage and object,
+// from OutRun2006Tweaks.lods.ini.
+//
+// The INI lists a hundred or so nodes across the whole game, so the sets are
+// only allocated for the stages and objects that actually have one. A lookup
+// is still two array indexes and a bit test, so the per-node check in the
+// draw loop stays as cheap as it was with every set allocated up front, and
+// the caller can hoist the first two out of the loop entirely with find().
+//
+// The INI stays the file people edit, but parsing it is slow enough to notice
+// at startup, so it's compiled to a flat list of (stage, object, node) next to
+// it and that gets loaded instead while it was built from the INI's current
+// contents. That's checked by hash rather than file time, so a prebuilt copy
+// stays valid however the two were copied around. Nothing here touches
+// Windows or the game, so the lodcompile tool builds it as well.
+class LodExclusions
+{
+public:
+	static constexpr int MaxStages = 128;
+	static constexpr int MaxObjects = 256;
+	static constexpr int MaxNodes = 16384;
+
+	using NodeSet = std::bitset<MaxNodes>;
+
+private:
+	using StageSets = std::array<std::unique_ptr<NodeSet>, MaxObjects>;
+
+	std::array<std::unique_ptr<StageSets>, MaxStages> stages_;
+	std::bitset<MaxStages> skipQuickSort_;
+	uint32_t generation_ = 0;
+
+	static bool in_range(int stage, int object)
+	{
+		return stage >= 0 && stage < MaxStages && object >= 0 && object < MaxObjects;
+	}
+
+public:
+	// Bumped on every change, so anything built from the sets can tell when
+	// to rebuild.
+	uint32_t generation() const { return generation_; }
+
+	// The object's set, or null if it has never had an exclusion.
+	const NodeSet* find(int stage, int object) const
+	{
+		if (!in_range(stage, object) || !stages_[stage])
+			return nullptr;
+
+		return (*stages_[stage])[object].get();
+	}
+
+	bool test(int stage, int object, int node) const
+	{
+		const NodeSet* set = find(stage, object);
+		return set && node >= 0 && node < MaxNodes && (*set)[node];
+	}
+
+	// Allocates the object's set on its first exclusion. Clearing one never
+	// frees it, since the debug window toggles nodes back and forth.
+	void set(int stage, int object, int node, bool excluded)
+	{
+		if (!in_range(stage, object) || node < 0 || node >= MaxNodes)
+			return;
+
+		if (!excluded && !find(stage, object))
+			return;
+
+		auto& stageSets = stages_[stage];
+		if (!stageSets)
+			stageSets = std::make_unique<StageSets>();
+
+		auto& nodes = (*stageSets)[object];
+		if (!nodes)
+			nodes = std::make_unique<NodeSet>();
+
+		(*nodes)[node] = excluded;
+		generation_++;
+	}
+
+	void clear_stage(int stage)
+	{
+		if (stage >= 0 && stage < MaxStages)
+		{
+			stages_[stage].reset();
+			generation_++;
+		}
+	}
+
+	void clear()
+	{
+		for (auto& stage : stages_)
+			stage.reset();
+		skipQuickSort_.reset();
+		generation_++;
+	}
+
+	// SkipQuickSort = True in a stage's section
+	bool skip_quick_sort(int stage) const
+	{
+		return stage >= 0 && stage < MaxStages && skipQuickSort_[stage];
+	}
+
+	// Size and content hash of the INI a compiled file was built from, so a
+	// stale one can be spotted without parsing the INI.
+	struct SourceStamp
+	{
+		uint64_t size = 0;
+		uint64_t hash = 0;
+
+		bool operator==(const SourceStamp&) const = default;
+	};
+
+	static bool stamp_of(const std::filesystem::path& path, SourceStamp& stamp);
+	static std::filesystem::path compiled_path(const std::filesystem::path& iniPath);
+
+	// Replaces the contents with the INI's. Anything that doesn't parse is
+	// skipped and described in warnings, the rest still loads.
+	bool parse_ini(std::string_view text, std::vector<std::string>& warnings);
+	bool read_ini(const std::filesystem::path& path, std::vector<std::string>& warnings);
+
+	std::vector<uint8_t> compile(const SourceStamp& source) const;
+	bool load_compiled(const uint8_t* data, size_t size, SourceStamp& source);
+
+	bool write_compiled(const std::filesystem::path& path, const SourceStamp& source) const;
+	bool read_compiled(const std::filesystem::path& path, SourceStamp& source);
+};
@@ -5,12 +5,16 @@
 #include "plugin.hpp"
 #include "game_addrs.hpp"
 #include "interpolation.hpp"
+#include "frame_pacing.hpp"
+#include "render_stats.hpp"
+#include "input_manager.hpp"
 #include <cmath>
 #include <imgui.h>
 #include "overlay.hpp"
 
 // Debug tab: game state readout, the switches for the free-floating tool
-// windows, and whether each hook managed to apply.
+// windows, input recording for benchmark laps, and whether each hook managed
+// to apply.
 class DebugWindow : public OverlayWindow
 {
 	static void draw_game_state()
@@ -83,6 +87,133 @@ class DebugWindow : public OverlayWindow
 #endif
 	}
 
+	static void draw_frame_pacing()
+	{
+		const auto& stats = FramePacing::Stats;
+
+		const auto& latency = stats.inputToPresent;
+		ImGui::Text("Input to present: %.2fms avg, %.2fms max (%d ticked frames/s)",
+			latency.avgMs, latency.maxMs, latency.samples);
+
+		ImGui::Text("Present interval: %.2fms avg, %.2fms max", stats.presentInterval.avgMs, stats.presentInterval.maxMs);
+		ImGui::Text("Present vs deadline: %+.2fms avg, %+.2fms worst", stats.presentError.avgMs, stats.presentError.maxMs);
+
+		// mean +- deviation, which is what the adaptive limiter budgets from
+		ImGui::Text("Tick %.2f +- %.2fms, interp %.2f +- %.2fms",
+			stats.tickCost.meanMs, stats.tickCost.devMs, stats.interpCost.meanMs, stats.interpCost.devMs);
+		ImGui::Text("Draw %.2f +- %.2fms, present %.2f +- %.2fms",
+			stats.drawCost.meanMs, stats.drawCost.devMs, stats.presentCost.meanMs, stats.presentCost.devMs);
+		ImGui::Text("Adaptive limiter: %d ticks predicted, released %.2fms early",
+			stats.predictedTicks, stats.wakeLeadMs);
+		ImGui::Text("Last load screen: %.0fms, %.0fms asleep on the loader thread",
+			stats.lastLoadMs, stats.lastLoadWaitMs);
+
+		ImGui::Text("UI sprite capture %.3fms, replay %.3fms, %d draws in %d bytes",
+			stats.spriteCaptureCost.meanMs, stats.spriteReplayCost.meanMs,
+			stats.spriteCapturedCount, stats.spriteCapturedBytes);
+		ImGui::Text("UI sprite captures unchanged: %d of %d",
+			stats.spriteCapturesUnchanged, stats.spriteCapturesTotal);
+	}
+
+	static void draw_stage_rendering()
+	{
+		const auto& stats = RenderStats::Stats;
+
+		ImGui::Text("Stage draw %.2fms, %d sections, %d after-draw entries",
+			stats.last.stageDrawMs, stats.sectionsDrawn, stats.last.aftEntries);
+		ImGui::Text("%d nodes gathered, %d excluded, %d objects drawn, %d immediate entries",
+			stats.last.nodesGathered, stats.last.nodesExcluded, stats.last.objectsDrawn, stats.last.immEntries);
+
+		if (ImGui::TreeNode("Average per stage"))
+		{
+			if (ImGui::BeginTable("##stageaverages", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+			{
+				ImGui::TableSetupColumn("Stage");
+				ImGui::TableSetupColumn("Nodes");
+				ImGui::TableSetupColumn("Excluded");
+				ImGui::TableSetupColumn("Objects");
+				ImGui::TableSetupColumn("Immediate");
+				ImGui::TableSetupColumn("After");
+				ImGui::TableSetupColumn("Sort ms");
+				ImGui::TableSetupColumn("Draw ms");
+				ImGui::TableHeadersRow();
+
+				for (int stage = 0; stage < int(stats.stageAverages.size()); stage++)
+				{
+					const auto& avg = stats.stageAverages[stage];
+					if (!avg.frames)
+						continue;
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::Text("%d (%s)", stage, Game::GetStageFriendlyName(GameStage(stage)));
+					ImGui::TableNextColumn(); ImGui::Text("%.0f", avg.nodesGathered);
+					ImGui::TableNextColumn(); ImGui::Text("%.0f", avg.nodesExcluded);
+					ImGui::TableNextColumn(); ImGui::Text("%.0f", avg.objectsDrawn);
+					ImGui::TableNextColumn(); ImGui::Text("%.0f", avg.immEntries);
+					ImGui::TableNextColumn(); ImGui::Text("%.0f", avg.aftEntries);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", avg.sortMs);
+					ImGui::TableNextColumn(); ImGui::Text("%.2f", avg.stageDrawMs);
+				}
+
+				ImGui::EndTable();
+			}
+			ImGui::TreePop();
+		}
+
+		ImGui::Text("Node gather %.3fms (peak %.3fms), %d section lists walked%s",
+			stats.gatherMs, stats.gatherPeakMs, stats.gatherSectionsWalked, stats.gatherParallel ? ", parallel" : "");
+
+		static const char* sortPaths[] = { "comparison", "coherent", "radix" };
+		ImGui::Text("Draw sort %.3f +- %.3fms over %d entries, last %s (%d coherent, %d radix)",
+			stats.sortCost.meanMs, stats.sortCost.devMs, stats.sortEntries, sortPaths[stats.sortPath],
+			stats.sortCoherentFrames, stats.sortRadixFrames);
+		ImGui::Checkbox("Always use comparison sort", &RenderStats::Stats.sortReference);
+
+		auto draw_buffer_usage = [](const char* name, const RenderStats::BufferUsage& usage)
+		{
+			ImGui::Text("%s: %d of %d, peak %d, %d frames full, grown %d times",
+				name, usage.lastFrame, usage.capacity, usage.peak, usage.saturatedFrames, usage.grows);
+		};
+		draw_buffer_usage("Immediate draw buffer", stats.immBuffer);
+		draw_buffer_usage("After draw buffer", stats.aftBuffer);
+
+		if (ImGui::TreeNode("Peak draw buffer use per stage"))
+		{
+			if (ImGui::BeginTable("##stagepeaks", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+			{
+				ImGui::TableSetupColumn("Stage");
+				ImGui::TableSetupColumn("Immediate");
+				ImGui::TableSetupColumn("After");
+				ImGui::TableHeadersRow();
+
+				for (int stage = 0; stage < int(stats.stagePeaks.size()); stage++)
+				{
+					const auto& peaks = stats.stagePeaks[stage];
+					if (!peaks.imm && !peaks.aft)
+						continue;
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::Text("%d (%s)", stage, Game::GetStageFriendlyName(GameStage(stage)));
+					ImGui::TableNextColumn(); ImGui::Text("%d", peaks.imm);
+					ImGui::TableNextColumn(); ImGui::Text("%d", peaks.aft);
+				}
+
+				ImGui::EndTable();
+			}
+			ImGui::TreePop();
+		}
+
+		if (!stats.adaptiveActive)
+		{
+			ImGui::TextDisabled("Adaptive draw distance off");
+			return;
+		}
+
+		ImGui::Text("Adaptive draw distance: %d of %d", stats.adaptiveDistance, stats.adaptiveMaxDistance);
+		ImGui::Text("Frame work %.2fms of %.2fms budget, %.3fms per section",
+			stats.adaptiveWorkMs, stats.adaptiveBudgetMs, stats.adaptiveMsPerSection);
+	}
+
 	// These write the game's own variables rather than any of our settings, so
 	// they aren't part of the generated settings tab.
 	static void draw_gameplay_toggles()
@@ -111,6 +242,62 @@ class DebugWindow : public OverlayWindow
 			Overlay::IsBindingDialogActive = true;
 	}
 
+	// Recordings live next to the DLL. A replayed race drives the game on its
+	// own, so frame pacing can be compared from build to build on the same lap.
+	static void draw_input_recording()
+	{
+		if (!Settings::UseNewInput)
+		{
+			ImGui::TextDisabled("Needs UseNewInput");
+			return;
+		}
+
+		static char fileName[MAX_PATH] = "benchmark.or2rec";
+		static std::string error;
+
+		auto& input = InputManager::instance;
+		const RecordState state = input.recordState();
+
+		ImGui::InputText("File", fileName, sizeof(fileName));
+		const auto path = Module::DllPath.parent_path() / fileName;
+
+		if (state == RecordState::Idle)
+		{
+			if (ImGui::Button("Record next race"))
+			{
+				input.armRecording(path);
+				error.clear();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Replay on next race") && input.armReplay(path, error))
+				error.clear();
+		}
+		else if (ImGui::Button("Stop"))
+			input.stopRecording();
+
+		const auto& recording = input.recording();
+		switch (state)
+		{
+		case RecordState::RecordArmed:
+			ImGui::Text("Waiting for a race to record");
+			break;
+		case RecordState::Recording:
+			ImGui::Text("Recording stage %d, %zu ticks", recording.stage, recording.ticks.size());
+			break;
+		case RecordState::ReplayArmed:
+			ImGui::Text("Waiting for a race to replay %zu ticks of stage %d", recording.ticks.size(), recording.stage);
+			break;
+		case RecordState::Replaying:
+			ImGui::Text("Replaying tick %zu of %zu", input.replayPosition(), recording.ticks.size());
+			break;
+		default:
+			break;
+		}
+
+		if (!error.empty())
+			ImGui::TextColored(ImVec4(0.9f, 0.4f, 0.4f, 1.f), "%s", error.c_str());
+	}
+
 	// A hook with no description is one that never logs either, so there is
 	// nothing useful to show for it.
 	static void draw_hook_status()
@@ -161,12 +348,21 @@ public:
 			draw_interpolation();
 #endif
 
+		if (ImGui::CollapsingHeader("Frame pacing"))
+			draw_frame_pacing();
+
+		if (ImGui::CollapsingHeader("Stage rendering"))
+			draw_stage_rendering();
+
 		if (ImGui::CollapsingHeader("Gameplay", ImGuiTreeNodeFlags_DefaultOpen))
 			draw_gameplay_toggles();
 
 		if (ImGui::CollapsingHeader("Tools", ImGuiTreeNodeFlags_DefaultOpen))
 			draw_tools();
 
+		if (ImGui::CollapsingHeader("Input recording"))
+			draw_input_recording();
+
 		if (ImGui::CollapsingHeader("Hooks"))
 			draw_hook_status();
 	}
@@ -8,6 +8,7 @@
 #include <backends/imgui_impl_win32.h>
 #include <backends/imgui_impl_dx9.h>
 #include "overlay.hpp"
+#include "frame_pacing.hpp"
 
 namespace Settings
 {
@@ -214,6 +215,12 @@ class D3DHooks : public Hook
 			ImGui::Render();
 			ImGui_ImplDX9_RenderDrawData(ImGui::GetDrawData());
 		}
+
+		// The render path's work is done once we get here, the rest of the
+		// frame is Present.
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		FramePacing::Stats.endSceneQpc = counter.QuadPart;
 	}
 
 	inline static SafetyHookMid midhook_d3dTemporariesRelease{};
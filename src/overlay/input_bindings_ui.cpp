@@ -358,7 +358,11 @@ private:
 
 			ImGui::PushID(int(i));
 			if (ImGui::RadioButton(SDL_GetGamepadName(controller), primary))
+			{
+				// The sampler and rumble threads read the primary pad under mtx
+				std::lock_guard<std::mutex> lock(manager.mtx);
 				manager.setPrimaryGamepad(i);
+			}
 			ImGui::PopID();
 		}
 
@@ -9,6 +9,9 @@ extern void DInput_RegisterNewDevices(); // hooks_input.cpp
 extern void SetVibration(int userId, float leftMotor, float rightMotor); // hooks_forcefeedback.cpp
 extern void AudioHooks_Update(int numUpdates); // hooks_audio.cpp
 extern void CDSwitcher_ReadIni(const std::filesystem::path& iniPath);
+extern bool FileLoad_WaitForLoader(DWORD timeoutMs); // hooks_bugfixes.cpp
+extern void DrawDist_Update(); // hooks_drawdistance.cpp
+extern void DrawDist_Shutdown(); // hooks_drawdistance.cpp
 
 namespace Module
 {
@@ -24,6 +27,7 @@ namespace Module
 	inline std::filesystem::path IniPath{};
 	inline std::filesystem::path UserIniPath{};
 	inline std::filesystem::path LodIniPath{};
+	inline std::filesystem::path DrawDistIniPath{};
 	inline std::filesystem::path OverlayIniPath{};
 	inline std::filesystem::path BindingsIniPath{};
 
@@ -95,6 +99,8 @@ namespace Settings
 	extern Setting<int> DrawDistanceBehind;                // hooks_drawdistance.cpp
 
 	extern Setting<bool> AllowFLAC;                        // hooks_flac.cpp
+	extern Setting<bool> AllowWAV;                         // hooks_audio.cpp
+	extern Setting<bool> CDSwitcherPreload;                // hooks_audio.cpp
 
 	extern Setting<bool> UseNewInput;                      // input_manager.cpp
 	extern Setting<bool> BypassGameSensitivity;            // input_manager.cpp
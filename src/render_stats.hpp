@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "frame_pacing.hpp"
+
+// What the stage draw hooks measure about the work they hand the game, for the
+// overlay readouts and frame telemetry. Written by hooks_drawdistance on the
+// render thread and read by the overlay on the same thread, so nothing here is
+// locked.
+namespace RenderStats
+{
+	// Tallied over one rendered frame. The node counts only cover stage
+	// objects, and only while DrawDistanceIncrease has DispStage hooked.
+	struct Counters
+	{
+		int nodesGathered = 0;  // culling nodes handed to DrawObject_Internal
+		int nodesExcluded = 0;  // in range, but left out by the LOD exclusions
+		int objectsDrawn = 0;   // stage objects with at least one node
+		int immEntries = 0;     // s_ImmDrawBuffer use, sampled
+		int aftEntries = 0;     // s_AftDrawBuffer entries drawn
+		float sortMs = 0.0f;    // sorting s_AftDrawBuffer
+		float stageDrawMs = 0.0f; // DispStage, plus drawing s_AftDrawBuffer
+	};
+
+	// Counters averaged over the frames rendered on one stage, weighted
+	// towards the recent ones.
+	struct StageAverages
+	{
+		int frames = 0;
+		float nodesGathered = 0.0f;
+		float nodesExcluded = 0.0f;
+		float objectsDrawn = 0.0f;
+		float immEntries = 0.0f;
+		float aftEntries = 0.0f;
+		float sortMs = 0.0f;
+		float stageDrawMs = 0.0f;
+
+		void add(const Counters& c)
+		{
+			// Plain average until there are enough frames for the rolling one
+			const float gain = frames < 64 ? 1.0f / float(frames + 1) : 1.0f / 64.0f;
+			nodesGathered += (c.nodesGathered - nodesGathered) * gain;
+			nodesExcluded += (c.nodesExcluded - nodesExcluded) * gain;
+			objectsDrawn += (c.objectsDrawn - objectsDrawn) * gain;
+			immEntries += (c.immEntries - immEntries) * gain;
+			aftEntries += (c.aftEntries - aftEntries) * gain;
+			sortMs += (c.sortMs - sortMs) * gain;
+			stageDrawMs += (c.stageDrawMs - stageDrawMs) * gain;
+			frames++;
+		}
+	};
+
+	// How full a draw buffer ran: the last frame, the most any frame has
+	// used, and how many frames filled it completely. A full buffer drops
+	// whatever else was queued that frame.
+	struct BufferUsage
+	{
+		int capacity = 0;
+		int lastFrame = 0;
+		int peak = 0;
+		int saturatedFrames = 0;
+		int grows = 0;
+	};
+
+	struct StagePeaks
+	{
+		int imm = 0;
+		int aft = 0;
+	};
+
+	struct State
+	{
+		// The frame being rendered, and the last one to finish
+		Counters frame;
+		Counters last;
+		std::array<StageAverages, 128> stageAverages{};
+
+		// Track sections the last DispStage drew from
+		int sectionsDrawn = 0;
+
+		// Adaptive draw distance: the distance it settled on for this frame,
+		// the most DrawDistanceIncrease allows, and what it is holding the
+		// frame's work against.
+		bool adaptiveActive = false;
+		int adaptiveDistance = 0;
+		int adaptiveMaxDistance = 0;
+		float adaptiveBudgetMs = 0.0f;
+		float adaptiveWorkMs = 0.0f;
+		float adaptiveMsPerSection = 0.0f;
+
+		// DrawDistanceIncrease: time spent gathering node lists last frame,
+		// the worst so far, how many section lists that walked in total, and
+		// whether it was split across the worker pool.
+		float gatherMs = 0.0f;
+		float gatherPeakMs = 0.0f;
+		int gatherSectionsWalked = 0;
+		bool gatherParallel = false;
+
+		// StableDrawSort: what sorting s_AftDrawBuffer costs, how big it was,
+		// and which way it was sorted last (0 comparison sort, 1 insertion
+		// sort from last frame's order, 2 radix sort). sortReference forces
+		// the comparison sort, to measure the others against.
+		FramePacing::Estimate sortCost;
+		int sortEntries = 0;
+		int sortPath = 0;
+		int sortCoherentFrames = 0;
+		int sortRadixFrames = 0;
+		bool sortReference = false;
+
+		// DrawBufferExtension: use of the two stage draw buffers, overall and
+		// the most each stage has needed, for tuning their starting sizes.
+		BufferUsage immBuffer;
+		BufferUsage aftBuffer;
+		std::array<StagePeaks, 128> stagePeaks{};
+	};
+
+	inline State Stats;
+
+	// Called by the update loop once the frame has been presented, with the
+	// stage it was rendered on or -1 outside of gameplay.
+	inline void EndFrame(int stage)
+	{
+		Stats.last = Stats.frame;
+		Stats.frame = {};
+
+		if (stage >= 0 && stage < int(Stats.stageAverages.size()))
+			Stats.stageAverages[stage].add(Stats.last);
+	}
+}
@@ -0,0 +1,189 @@
+#include "hook_mgr.hpp"
+#include "plugin.hpp"
+#include "sound_index.hpp"
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace SoundIndex
+{
+	// File sizes by lowercased filename
+	using Listing = std::unordered_map<std::wstring, uint64_t>;
+
+	struct Directory
+	{
+		std::filesystem::path path;
+		HANDLE change = INVALID_HANDLE_VALUE;
+		Listing files;
+	};
+
+	static std::mutex Mutex;
+	static std::unordered_map<std::wstring, Directory> Directories; // by lowercased absolute path
+	static HANDLE DirectoriesChanged = nullptr;
+	static bool WatcherStarted = false;
+
+	static std::wstring Lower(std::wstring text)
+	{
+		if (!text.empty())
+			CharLowerBuffW(text.data(), DWORD(text.size()));
+		return text;
+	}
+
+	// Absolute, normalised path. Only string work, nothing here touches the disk.
+	static std::filesystem::path Full(const std::filesystem::path& path)
+	{
+		std::error_code ec;
+		auto full = std::filesystem::absolute(path, ec);
+		if (ec)
+			return path.lexically_normal();
+		return full.lexically_normal();
+	}
+
+	static bool Scan(const std::filesystem::path& path, Listing& files)
+	{
+		std::error_code ec;
+		std::filesystem::directory_iterator it(path, ec);
+		if (ec)
+			return false;
+
+		files.clear();
+		for (const auto& entry : it)
+		{
+			if (!entry.is_regular_file(ec))
+				continue;
+
+			const uint64_t size = entry.file_size(ec);
+			files[Lower(entry.path().filename().native())] = ec ? 0 : size;
+		}
+		return true;
+	}
+
+	static void WatchThread()
+	{
+		for (;;)
+		{
+			std::vector<HANDLE> handles{ DirectoriesChanged };
+			std::vector<std::wstring> keys{ L"" };
+			{
+				std::lock_guard lock(Mutex);
+				for (const auto& [key, directory] : Directories)
+				{
+					handles.push_back(directory.change);
+					keys.push_back(key);
+				}
+			}
+
+			const DWORD result = WaitForMultipleObjects(DWORD(handles.size()), handles.data(), FALSE, INFINITE);
+			const DWORD index = result - WAIT_OBJECT_0;
+			if (index >= handles.size())
+			{
+				spdlog::error("SoundIndex: waiting for changes failed ({}), no longer watching", GetLastError());
+				return;
+			}
+
+			// Index 0 means a folder was added, go round and wait on it too
+			if (index == 0)
+				continue;
+
+			FindNextChangeNotification(handles[index]);
+
+			std::filesystem::path path;
+			{
+				std::lock_guard lock(Mutex);
+				path = Directories[keys[index]].path;
+			}
+
+			// Scan without holding the lock, lookups only wait for the swap
+			Listing files;
+			const bool scanned = Scan(path, files);
+
+			std::lock_guard lock(Mutex);
+			if (scanned)
+				Directories[keys[index]].files = std::move(files);
+			else
+				Directories[keys[index]].files.clear(); // folder went away
+
+			spdlog::debug("SoundIndex: rescanned {}", path.string());
+		}
+	}
+
+	bool AddDirectory(const std::filesystem::path& path)
+	{
+		const auto full = Full(path);
+		const auto key = Lower(full.native());
+
+		{
+			std::lock_guard lock(Mutex);
+			if (Directories.contains(key))
+				return true;
+
+			// Watcher waits on every folder plus its own wake event
+			if (Directories.size() >= MAXIMUM_WAIT_OBJECTS - 1)
+				return false;
+		}
+
+		Directory directory;
+		directory.path = full;
+		if (!Scan(full, directory.files))
+			return false;
+
+		directory.change = FindFirstChangeNotificationW(full.c_str(), FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+		if (directory.change == INVALID_HANDLE_VALUE)
+			return false;
+
+		std::lock_guard lock(Mutex);
+
+		// Checked again, another caller may have added it or filled the last
+		// slot while this one was scanning
+		const bool added = Directories.contains(key);
+		if (added || Directories.size() >= MAXIMUM_WAIT_OBJECTS - 1)
+		{
+			FindCloseChangeNotification(directory.change);
+			return added;
+		}
+
+		spdlog::info("SoundIndex: watching {} ({} files)", full.string(), directory.files.size());
+		Directories.emplace(key, std::move(directory));
+
+		if (!WatcherStarted)
+		{
+			DirectoriesChanged = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+			std::thread(WatchThread).detach();
+			WatcherStarted = true;
+		}
+		SetEvent(DirectoriesChanged);
+
+		return true;
+	}
+
+	bool Exists(const std::filesystem::path& path, uint64_t* size)
+	{
+		const auto full = Full(path);
+
+		{
+			std::lock_guard lock(Mutex);
+			const auto directory = Directories.find(Lower(full.parent_path().native()));
+			if (directory != Directories.end())
+			{
+				const auto file = directory->second.files.find(Lower(full.filename().native()));
+				if (file == directory->second.files.end())
+					return false;
+
+				if (size)
+					*size = file->second;
+				return true;
+			}
+		}
+
+		std::error_code ec;
+		if (!std::filesystem::exists(path, ec))
+			return false;
+
+		if (size)
+			*size = std::filesystem::file_size(path, ec);
+		return true;
+	}
+}
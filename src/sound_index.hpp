@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Listing of the folders BGM gets loaded from, so checking which of a track's
+// formats exist doesn't go to the filesystem on the game thread. Folders are
+// scanned once when added, then rescanned by a watcher thread whenever
+// Windows reports a change in them.
+//
+// Paths in folders that weren't added fall back to std::filesystem.
+namespace SoundIndex
+{
+	// Lists the folder and starts watching it. False if it can't be read.
+	bool AddDirectory(const std::filesystem::path& path);
+
+	bool Exists(const std::filesystem::path& path, uint64_t* size = nullptr);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A few threads that split an index range with the calling thread. Meant for
+// short bursts of work in the middle of a frame: run() returns once every
+// index is done, and the workers sleep on a condition variable in between.
+//
+// Indices are handed out one at a time from a shared counter, so a slow one
+// doesn't hold up the rest, and anything the callback writes should be keyed
+// by its index.
+//
+// Pools are created once and live for the rest of the process. Joining in a
+// destructor would run under the loader lock at DLL unload.
+class WorkerPool
+{
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+
+	const std::function<void(int)>* job_ = nullptr;
+	int count_ = 0;
+	std::atomic<int> next_ = 0;
+	int active_ = 0; // workers still inside the current burst
+	uint64_t burst_ = 0;
+
+	void drain(const std::function<void(int)>& job, int count)
+	{
+		for (int i = next_.fetch_add(1); i < count; i = next_.fetch_add(1))
+			job(i);
+	}
+
+	void worker_main()
+	{
+		uint64_t seen = 0;
+		for (;;)
+		{
+			std::unique_lock lock(mutex_);
+			wake_.wait(lock, [&] { return burst_ != seen; });
+			seen = burst_;
+			const auto* job = job_;
+			const int count = count_;
+			lock.unlock();
+
+			drain(*job, count);
+
+			lock.lock();
+			if (--active_ == 0)
+				done_.notify_one();
+		}
+	}
+
+public:
+	explicit WorkerPool(int numThreads)
+	{
+		for (int i = 0; i < numThreads; i++)
+		{
+			threads_.emplace_back(&WorkerPool::worker_main, this);
+			threads_.back().detach();
+		}
+	}
+
+	// Threads working a burst, including the caller
+	int size() const { return int(threads_.size()) + 1; }
+
+	void run(int count, const std::function<void(int)>& job)
+	{
+		if (threads_.empty() || count <= 1)
+		{
+			for (int i = 0; i < count; i++)
+				job(i);
+			return;
+		}
+
+		{
+			std::lock_guard lock(mutex_);
+			job_ = &job;
+			count_ = count;
+			next_ = 0;
+			active_ = int(threads_.size());
+			burst_++;
+		}
+		wake_.notify_all();
+
+		drain(job, count);
+
+		std::unique_lock lock(mutex_);
+		done_.wait(lock, [&] { return active_ == 0; });
+	}
+};
@@ -0,0 +1,319 @@
+// Decodes FLACs through FLACStream the way the game's BGM player does, checks
+// the output sample for sample against a plain libFLAC decode, and reports
+// how fast that went and how much memory the stream held onto.
+//
+// Looping files are read through a few loops, and checked against the
+// reference decode spliced at the loop points, so a seam that drops, repeats
+// or shifts a sample fails. Each stream is then reset, like the game's
+// ResetFile, and has to start over cleanly from the first sample.
+//
+// --generate writes a corpus of synthetic files to the given folder first,
+// then checks those along with any files given. It covers 16/24/32-bit mono
+// and stereo with no loop tags, LOOPSTART with LOOPLENGTH, and LOOPSTART with
+// LOOPEND, and every interleaving kernel (1-8 channels at each depth) encoded
+// with odd block sizes, so the kernels' leftover samples get compared against
+// the reference decode as well.
+//
+//   bgmbench [--loops N] [--generate <folder>] [file.flac...]
+
+#include "flac_stream.hpp"
+#include <FLAC/metadata.h>
+#include <FLAC/stream_encoder.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// The game reads its streaming buffer in chunks around this size
+	constexpr size_t ReadChunk = 16 * 1024;
+	constexpr auto ReadTimeout = std::chrono::seconds(5);
+
+	struct Reference
+	{
+		std::vector<uint8_t> pcm;
+		unsigned blockAlign = 0;
+	};
+
+	// Deliberately the simplest conversion possible, nothing shared with
+	// FLACStream's kernels
+	FLAC__StreamDecoderWriteStatus reference_write(const FLAC__StreamDecoder*, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* client_data)
+	{
+		auto* ref = static_cast<Reference*>(client_data);
+		const unsigned bytes = frame->header.bits_per_sample / 8;
+		ref->blockAlign = frame->header.channels * bytes;
+
+		for (unsigned i = 0; i < frame->header.blocksize; i++)
+			for (unsigned channel = 0; channel < frame->header.channels; channel++)
+				for (unsigned b = 0; b < bytes; b++)
+					ref->pcm.push_back(uint8_t(uint32_t(buffer[channel][i]) >> (8 * b)));
+
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	}
+
+	void reference_error(const FLAC__StreamDecoder*, FLAC__StreamDecoderErrorStatus, void*) {}
+
+	bool decode_reference(const std::string& path, Reference& ref)
+	{
+		FLAC__StreamDecoder* decoder = FLAC__stream_decoder_new();
+		if (!decoder)
+			return false;
+
+		bool ok = FLAC__stream_decoder_init_file(decoder, path.c_str(), reference_write, nullptr, reference_error, &ref) == FLAC__STREAM_DECODER_INIT_STATUS_OK &&
+			FLAC__stream_decoder_process_until_end_of_stream(decoder);
+
+		FLAC__stream_decoder_finish(decoder);
+		FLAC__stream_decoder_delete(decoder);
+		return ok && ref.blockAlign;
+	}
+
+	// What FLACStream should produce for the first `samples` samples: the
+	// track up to the loop end, then the loop over and over
+	std::vector<uint8_t> expected_output(const Reference& ref, const FLACStream::Loop& loop, uint64_t samples)
+	{
+		const uint64_t total = ref.pcm.size() / ref.blockAlign;
+		if (!loop.enabled)
+			return ref.pcm;
+
+		// A loop end past the last sample loops from the end instead
+		const uint64_t end = std::min(loop.end, total);
+
+		std::vector<uint8_t> out;
+		out.reserve(size_t(samples * ref.blockAlign));
+
+		uint64_t pos = 0;
+		while (out.size() < samples * ref.blockAlign)
+		{
+			out.insert(out.end(), ref.pcm.begin() + size_t(pos * ref.blockAlign), ref.pcm.begin() + size_t(pos * ref.blockAlign) + ref.blockAlign);
+			if (++pos >= end)
+				pos = loop.start;
+		}
+		return out;
+	}
+
+	bool check_file(const std::string& path, int loops)
+	{
+		Reference ref;
+		const auto refStart = std::chrono::steady_clock::now();
+		if (!decode_reference(path, ref))
+		{
+			printf("FAIL %s: reference decode failed\n", path.c_str());
+			return false;
+		}
+		const double refSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - refStart).count();
+
+		const auto start = std::chrono::steady_clock::now();
+
+		FLACStream stream;
+		if (!stream.open_file(path.c_str()))
+		{
+			printf("FAIL %s: %s\n", path.c_str(), stream.error().c_str());
+			return false;
+		}
+
+		const auto format = stream.format();
+		const auto loop = stream.loop();
+		const uint64_t total = ref.pcm.size() / ref.blockAlign;
+
+		// Enough to run through the loop seam `loops` times
+		uint64_t wantSamples = total;
+		if (loop.enabled)
+		{
+			const uint64_t end = std::min(loop.end, total);
+			wantSamples = end + (end - loop.start) * loops + format.sampleRate / 10;
+		}
+
+		std::vector<uint8_t> out;
+		out.reserve(size_t(wantSamples * format.blockAlign));
+		std::vector<uint8_t> chunk(ReadChunk);
+		size_t peakMemory = stream.memory_bytes();
+
+		while (out.size() < wantSamples * format.blockAlign)
+		{
+			const size_t want = std::min(chunk.size(), size_t(wantSamples * format.blockAlign - out.size()));
+			const size_t read = stream.read(chunk.data(), want, std::chrono::duration_cast<std::chrono::milliseconds>(ReadTimeout));
+			out.insert(out.end(), chunk.begin(), chunk.begin() + read);
+			peakMemory = std::max(peakMemory, stream.memory_bytes());
+			if (read < want)
+				break;
+		}
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const std::string streamError = stream.error();
+		const unsigned underruns = stream.underruns();
+
+		// What the game's ResetFile does, it should start over from the top
+		const size_t restartBytes = std::min(out.size(), size_t(format.sampleRate) * format.blockAlign);
+		std::vector<uint8_t> restarted(restartBytes);
+		stream.reset();
+		restarted.resize(stream.read(restarted.data(), restarted.size(), std::chrono::duration_cast<std::chrono::milliseconds>(ReadTimeout)));
+		stream.close();
+
+		const auto expected = expected_output(ref, loop, wantSamples);
+
+		std::string result = "ok";
+		if (out.size() != expected.size())
+			result = "length " + std::to_string(out.size() / format.blockAlign) + " samples, expected " + std::to_string(expected.size() / format.blockAlign);
+
+		const size_t compare = std::min(out.size(), expected.size());
+		const auto mismatch = std::mismatch(out.begin(), out.begin() + compare, expected.begin());
+		if (mismatch.first != out.begin() + compare)
+			result = "sample " + std::to_string((mismatch.first - out.begin()) / format.blockAlign) + " differs";
+		else if (restarted.size() != restartBytes || !std::equal(restarted.begin(), restarted.end(), out.begin()))
+			result = "output after reset differs";
+
+		const double audioSeconds = double(out.size() / format.blockAlign) / format.sampleRate;
+		printf("%s %s: %uch %u-bit %uHz, %llu samples", result == "ok" ? "ok  " : "FAIL", path.c_str(),
+			format.channels, format.bitsPerSample, format.sampleRate, (unsigned long long)total);
+		if (loop.enabled)
+			printf(", loop %llu-%llu x%d", (unsigned long long)loop.start, (unsigned long long)loop.end, loops);
+		printf("\n     stream %.1fx realtime (%.1fMB/s), reference %.1fx, peak stream memory %.2fMB vs %.2fMB whole track, %u underruns\n",
+			audioSeconds / seconds, out.size() / seconds / 1e6, (double(total) / format.sampleRate) / refSeconds,
+			peakMemory / 1e6, ref.pcm.size() / 1e6, underruns);
+		if (result != "ok")
+			printf("     %s%s%s\n", result.c_str(), streamError.empty() ? "" : ", ", streamError.c_str());
+
+		return result == "ok";
+	}
+
+	// A couple of tones and some noise at close to full scale, so the top
+	// bits of every sample get exercised. blockSize 0 leaves it to the encoder.
+	bool write_test_file(const std::filesystem::path& path, unsigned channels, unsigned bits, unsigned blockSize, const std::vector<std::string>& tags)
+	{
+		constexpr unsigned SampleRate = 44100;
+		constexpr unsigned Samples = SampleRate * 3 + 1234; // not a whole number of blocks
+
+		FLAC__StreamEncoder* encoder = FLAC__stream_encoder_new();
+		if (!encoder)
+			return false;
+
+		FLAC__stream_encoder_set_channels(encoder, channels);
+		FLAC__stream_encoder_set_bits_per_sample(encoder, bits);
+		FLAC__stream_encoder_set_sample_rate(encoder, SampleRate);
+		FLAC__stream_encoder_set_compression_level(encoder, 5);
+		FLAC__stream_encoder_set_total_samples_estimate(encoder, Samples);
+		if (blockSize)
+			FLAC__stream_encoder_set_blocksize(encoder, blockSize);
+
+		FLAC__StreamMetadata* comments = FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT);
+		for (const auto& tag : tags)
+		{
+			const auto eq = tag.find('=');
+			FLAC__StreamMetadata_VorbisComment_Entry entry;
+			FLAC__metadata_object_vorbiscomment_entry_from_name_value_pair(&entry, tag.substr(0, eq).c_str(), tag.substr(eq + 1).c_str());
+			FLAC__metadata_object_vorbiscomment_append_comment(comments, entry, false);
+		}
+		FLAC__stream_encoder_set_metadata(encoder, &comments, 1);
+
+		bool ok = FLAC__stream_encoder_init_file(encoder, path.string().c_str(), nullptr, nullptr) == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+
+		const double peak = double((int64_t(1) << (bits - 1)) - 1);
+		uint32_t noise = 12345;
+		std::vector<FLAC__int32> block;
+		for (unsigned pos = 0; ok && pos < Samples; )
+		{
+			const unsigned count = std::min(4096u, Samples - pos);
+			block.resize(size_t(count) * channels);
+			for (unsigned i = 0; i < count; i++)
+				for (unsigned channel = 0; channel < channels; channel++)
+				{
+					noise = noise * 1664525u + 1013904223u;
+					const double t = double(pos + i) / SampleRate;
+					const double value = 0.6 * sin(t * 440.0 * 6.2831853 * (channel + 1)) + 0.3 * sin(t * 3.7) +
+						0.09 * (double(noise >> 8) / double(1 << 24) - 0.5);
+					block[size_t(i) * channels + channel] = FLAC__int32(std::llround(value * peak));
+				}
+
+			ok = FLAC__stream_encoder_process_interleaved(encoder, block.data(), count);
+			pos += count;
+		}
+
+		ok = FLAC__stream_encoder_finish(encoder) && ok;
+		FLAC__stream_encoder_delete(encoder);
+		FLAC__metadata_object_delete(comments);
+		return ok;
+	}
+
+	bool generate_corpus(const std::filesystem::path& folder, std::vector<std::string>& files)
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(folder, ec);
+
+		// Loop points that don't line up with block boundaries
+		const std::vector<std::pair<const char*, std::vector<std::string>>> loopTags = {
+			{ "noloop", {} },
+			{ "looplength", { "LOOPSTART=12345", "LOOPLENGTH=70001" } },
+			{ "loopend", { "loopstart=20000", "LoopEnd=99999" } },
+		};
+
+		for (unsigned bits : { 16u, 24u, 32u })
+			for (unsigned channels : { 1u, 2u })
+				for (const auto& [name, tags] : loopTags)
+				{
+					const auto path = folder / (std::to_string(bits) + "bit_" + (channels == 1 ? "mono_" : "stereo_") + name + ".flac");
+					if (!write_test_file(path, channels, bits, 0, tags))
+					{
+						fprintf(stderr, "bgmbench: failed to write %s\n", path.string().c_str());
+						return false;
+					}
+					files.push_back(path.string());
+				}
+
+		// Every kernel, with blocks that aren't a multiple of the SIMD width,
+		// down to the smallest block FLAC allows
+		for (unsigned bits : { 16u, 24u, 32u })
+			for (unsigned channels = 1; channels <= 8; channels++)
+				for (unsigned blockSize : { 16u, 1151u })
+				{
+					const auto path = folder / (std::to_string(bits) + "bit_" + std::to_string(channels) + "ch_block" + std::to_string(blockSize) + ".flac");
+					if (!write_test_file(path, channels, bits, blockSize, {}))
+					{
+						fprintf(stderr, "bgmbench: failed to write %s\n", path.string().c_str());
+						return false;
+					}
+					files.push_back(path.string());
+				}
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int loops = 3;
+	std::vector<std::string> files;
+	std::filesystem::path generateFolder;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+			loops = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc)
+			generateFolder = argv[++i];
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (!generateFolder.empty() && !generate_corpus(generateFolder, files))
+		return 1;
+
+	if (files.empty())
+	{
+		fprintf(stderr, "usage: bgmbench [--loops N] [--generate <folder>] [file.flac...]\n");
+		return 2;
+	}
+
+	int failed = 0;
+	for (const auto& file : files)
+		if (!check_file(file, loops))
+			failed++;
+
+	printf("%zu files, %d failed\n", files.size(), failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+// Checks StableDrawSort's radix and coherent sorts against std::sort, and
+// times all three.
+//
+// Keys are synthetic but shaped like the stage draw list: depths spread over
+// a few hundred metres with clusters of equal keys (nodes sharing a centre and
+// radius), negative and positive zero among them. For each list size, a run of
+// frames is generated where every frame nudges the last one's depths the way
+// driving forward does, so the coherent sort gets the same kind of input it
+// does in game. Every result is compared against std::sort on
+// (float key, index), the order the game's comparison sort produces.
+//
+//   drawsortbench [--frames N] [size...]
+
+#include "draw_sort.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Timings
+	{
+		double reference = 0.0;
+		double radix = 0.0;
+		double coherent = 0.0;
+		int coherentFrames = 0;
+	};
+
+	double ms_since(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// What the game's comparator does, on the float keys directly
+	std::vector<uint32_t> reference_order(const std::vector<float>& keys)
+	{
+		std::vector<uint32_t> order(keys.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = uint32_t(i);
+
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+			{
+				if (keys[a] < keys[b])
+					return true;
+				if (keys[b] < keys[a])
+					return false;
+				return a < b;
+			});
+		return order;
+	}
+
+	bool matches(const std::vector<DrawSort::Item>& items, const std::vector<uint32_t>& order, const char* path, size_t size, int frame)
+	{
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			if (items[i].index != order[i])
+			{
+				printf("FAIL: %s sort of %zu keys differs from std::sort at %zu on frame %d\n", path, size, i, frame);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<float> first_frame(std::mt19937& rng, size_t size)
+	{
+		std::uniform_real_distribution<float> depth(-400.0f, 5.0f);
+		std::uniform_int_distribution<int> pick(0, 15);
+
+		std::vector<float> keys(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			switch (pick(rng))
+			{
+			case 0: keys[i] = i ? keys[i - 1] : 0.0f; break; // same key as the entry before
+			case 1: keys[i] = pick(rng) & 1 ? 0.0f : -0.0f; break;
+			default: keys[i] = depth(rng); break;
+			}
+		}
+		return keys;
+	}
+
+	// Everything comes a little closer, by about the same amount, with a bit
+	// of jitter from turning, so only neighbours tend to swap
+	void next_frame(std::mt19937& rng, std::vector<float>& keys)
+	{
+		std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+		for (float& key : keys)
+			key += 0.5f + jitter(rng);
+	}
+
+	bool run(size_t size, int frames, Timings& timings)
+	{
+		std::mt19937 rng{ uint32_t(size) };
+		std::vector<float> keys = first_frame(rng, size);
+
+		std::vector<DrawSort::Item> items(size), scratch(size);
+		std::vector<uint32_t> prevOrder;
+
+		for (int frame = 0; frame < frames; frame++)
+		{
+			auto start = Clock::now();
+			const auto order = reference_order(keys);
+			timings.reference += ms_since(start);
+
+			start = Clock::now();
+			for (size_t i = 0; i < size; i++)
+				items[i] = { DrawSort::SortableKey(keys[i]), uint32_t(i) };
+			DrawSort::SortRadix(items.data(), scratch.data(), int(size));
+			timings.radix += ms_since(start);
+
+			if (!matches(items, order, "radix", size, frame))
+				return false;
+
+			// As the hook does it: from last frame's order, radix sorting
+			// instead if that gives up
+			start = Clock::now();
+			bool coherent = prevOrder.size() == size;
+			if (coherent)
+			{
+				for (size_t i = 0; i < size; i++)
+					items[i] = { DrawSort::SortableKey(keys[prevOrder[i]]), prevOrder[i] };
+				coherent = DrawSort::SortCoherent(items.data(), int(size));
+			}
+			if (!coherent)
+			{
+				for (size_t i = 0; i < size; i++)
+					items[i] = { DrawSort::SortableKey(keys[i]), uint32_t(i) };
+				DrawSort::SortRadix(items.data(), scratch.data(), int(size));
+			}
+			timings.coherent += ms_since(start);
+			timings.coherentFrames += coherent;
+
+			if (!matches(items, order, coherent ? "coherent" : "fallback radix", size, frame))
+				return false;
+
+			prevOrder.resize(size);
+			for (size_t i = 0; i < size; i++)
+				prevOrder[i] = items[i].index;
+
+			next_frame(rng, keys);
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int frames = 600;
+	std::vector<size_t> sizes;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (atoi(argv[i]) > 0)
+			sizes.push_back(size_t(atoi(argv[i])));
+		else
+		{
+			fprintf(stderr, "usage: drawsortbench [--frames N] [size...]\n");
+			return 2;
+		}
+	}
+
+	if (sizes.empty())
+		sizes = { 1, 2, 64, 512, 2048, 8192, 32768 };
+	if (frames < 1)
+		frames = 1;
+
+	printf("%8s  %12s  %12s  %12s  %s\n", "keys", "std::sort", "radix", "coherent", "coherent frames");
+
+	bool ok = true;
+	for (size_t size : sizes)
+	{
+		// The hook's fast paths index entries with 16 bits
+		if (size > 0xFFFF)
+		{
+			printf("%8zu  skipped, StableDrawSort falls back to std::sort past 65535 entries\n", size);
+			continue;
+		}
+
+		Timings timings;
+		if (!run(size, frames, timings))
+		{
+			ok = false;
+			continue;
+		}
+
+		printf("%8zu  %9.4fms  %9.4fms  %9.4fms  %d of %d\n", size,
+			timings.reference / frames, timings.radix / frames, timings.coherent / frames,
+			timings.coherentFrames, frames);
+	}
+
+	printf(ok ? "all sorts match std::sort\n" : "MISMATCH\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+// Compiles OutRun2006Tweaks.lods.ini into the binary form the DLL loads.
+//
+// The DLL does this itself whenever the INI's contents no longer match its
+// compiled copy, so this is only needed to ship a prebuilt one or to check an
+// edited INI without starting the game. --verify reads the written file back
+// and makes sure it round-trips to the same exclusions. --selftest runs the
+// parser and compiled format over generated INIs instead: every number
+// format, comment and separator the INI allows, lines that must be skipped
+// with a warning, compiled files that must be rejected, and stamps that must
+// go stale when the INI changes.
+//
+//   lodcompile [--verify] <lods.ini> [output.bin]
+//   lodcompile --selftest
+
+#include "lod_exclusions.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <tuple>
+
+namespace
+{
+	// Same sequence on every machine, unlike std::rand
+	struct Lcg
+	{
+		uint32_t state;
+		uint32_t next() { state = state * 1664525u + 1013904223u; return state >> 8; }
+		int below(int n) { return int(next() % uint32_t(n)); }
+	};
+
+	// Compiled layout, as lod_exclusions.cpp writes it
+	constexpr size_t HeaderSize = 48;
+	constexpr size_t EntrySize = 4;
+
+	using Node = std::tuple<int, int, int>; // stage, object, node
+
+	struct Expected
+	{
+		std::set<Node> nodes;
+		std::set<int> skipQuickSort;
+	};
+
+	// The same number in any of the forms the INI accepts
+	std::string number(Lcg& rng, int value)
+	{
+		char text[32];
+		switch (rng.below(3))
+		{
+		case 0: snprintf(text, sizeof(text), "0x%X", value); break;
+		case 1: snprintf(text, sizeof(text), value ? "0%o" : "0", value); break;
+		default: snprintf(text, sizeof(text), "%d", value); break;
+		}
+		return text;
+	}
+
+	// An INI in every style the parser has to cope with, and what it should
+	// load as
+	std::string generate_ini(uint32_t seed, Expected& expected)
+	{
+		Lcg rng{ seed };
+		std::string ini = "\xEF\xBB\xBF; generated by lodcompile --selftest\r\n";
+
+		const int stages = 1 + rng.below(12);
+		for (int s = 0; s < stages; s++)
+		{
+			const int stage = rng.below(LodExclusions::MaxStages);
+			ini += "\r\n[Stage " + std::to_string(stage) + "]\r\n";
+			if (rng.below(4) == 0)
+				ini += "# a comment line\r\n";
+			if (rng.below(5) == 0)
+			{
+				ini += "SkipQuickSort = True\r\n";
+				expected.skipQuickSort.insert(stage);
+			}
+
+			const int objects = 1 + rng.below(6);
+			for (int o = 0; o < objects; o++)
+			{
+				const int object = rng.below(LodExclusions::MaxObjects);
+				ini += number(rng, object) + (rng.below(2) ? " = " : ":");
+
+				const int count = 1 + rng.below(40);
+				for (int n = 0; n < count; n++)
+				{
+					const int node = rng.below(LodExclusions::MaxNodes);
+					ini += number(rng, node);
+					ini += rng.below(8) == 0 ? " , ," : ", ";
+					expected.nodes.insert({ stage, object, node });
+				}
+
+				ini += rng.below(3) == 0 ? " ; an inline comment\r\n" : "\n";
+			}
+		}
+		return ini;
+	}
+
+	bool matches(const LodExclusions& exclusions, const Expected& expected, const char* what)
+	{
+		for (const auto& [stage, object, node] : expected.nodes)
+			if (!exclusions.test(stage, object, node))
+			{
+				printf("FAIL: %s is missing stage %d object %d node %d\n", what, stage, object, node);
+				return false;
+			}
+
+		// Every node compiles to one entry, so this catches extra ones
+		const size_t count = (exclusions.compile({}).size() - HeaderSize) / EntrySize;
+		if (count != expected.nodes.size())
+		{
+			printf("FAIL: %s has %zu nodes, expected %zu\n", what, count, expected.nodes.size());
+			return false;
+		}
+
+		for (int stage = 0; stage < LodExclusions::MaxStages; stage++)
+			if (exclusions.skip_quick_sort(stage) != (expected.skipQuickSort.count(stage) != 0))
+			{
+				printf("FAIL: %s has the wrong SkipQuickSort for stage %d\n", what, stage);
+				return false;
+			}
+		return true;
+	}
+
+	bool round_trips(uint32_t seed)
+	{
+		Expected expected;
+		const std::string ini = generate_ini(seed, expected);
+
+		auto parsed = std::make_unique<LodExclusions>();
+		std::vector<std::string> warnings;
+		parsed->parse_ini(ini, warnings);
+		if (!warnings.empty())
+		{
+			printf("FAIL: seed %u warned: %s\n", seed, warnings[0].c_str());
+			return false;
+		}
+		if (!matches(*parsed, expected, "parsed INI"))
+			return false;
+
+		const LodExclusions::SourceStamp stamp{ ini.size(), seed };
+		const auto data = parsed->compile(stamp);
+
+		auto loaded = std::make_unique<LodExclusions>();
+		LodExclusions::SourceStamp loadedStamp;
+		if (!loaded->load_compiled(data.data(), data.size(), loadedStamp) || !(loadedStamp == stamp))
+		{
+			printf("FAIL: seed %u didn't load back\n", seed);
+			return false;
+		}
+		if (!matches(*loaded, expected, "compiled file") || loaded->compile(loadedStamp) != data)
+			return false;
+
+		printf("ok: %zu nodes round-trip in %zu bytes\n", expected.nodes.size(), data.size());
+		return true;
+	}
+
+	// Each bad line should cost one warning and nothing else
+	bool skips_bad_lines()
+	{
+		const char* ini =
+			"[Stage 4]\n"
+			"1 = 10, 12a, 11\n"          // malformed token
+			"1 = 0x, 09, -3, 16384\n"    // empty hex, bad octal, negative, out of range
+			"256 = 1\n"                  // object out of range
+			"abc = 1\n"                  // object not a number
+			"just some words\n"          // no separator
+			"SkipQuickSort = maybe\n"
+			"[Stage 128]\n"              // stage out of range, its lines are skipped
+			"1 = 1\n"
+			"[Stage 5\n"                 // unterminated
+			"1 = 2\n"
+			"[Stage 4]\n"
+			"2 = 0x10 ; 3\n";            // only the comment is dropped
+		const size_t expectedWarnings = 11;
+
+		Expected expected;
+		expected.nodes = { { 4, 1, 10 }, { 4, 1, 11 }, { 4, 2, 16 } };
+
+		auto parsed = std::make_unique<LodExclusions>();
+		std::vector<std::string> warnings;
+		parsed->parse_ini(ini, warnings);
+		if (warnings.size() != expectedWarnings)
+		{
+			printf("FAIL: bad lines gave %zu warnings, expected %zu\n", warnings.size(), expectedWarnings);
+			for (const auto& warning : warnings)
+				printf("      %s\n", warning.c_str());
+			return false;
+		}
+		if (!matches(*parsed, expected, "INI with bad lines"))
+			return false;
+
+		printf("ok: %zu bad lines skipped with a warning each\n", expectedWarnings);
+		return true;
+	}
+
+	bool rejects(const std::vector<uint8_t>& data, const char* what)
+	{
+		auto loaded = std::make_unique<LodExclusions>();
+		LodExclusions::SourceStamp stamp;
+		if (loaded->load_compiled(data.data(), data.size(), stamp))
+		{
+			printf("FAIL: %s still loads\n", what);
+			return false;
+		}
+		return true;
+	}
+
+	bool rejects_damage()
+	{
+		Expected expected;
+		auto exclusions = std::make_unique<LodExclusions>();
+		std::vector<std::string> warnings;
+		exclusions->parse_ini(generate_ini(7, expected), warnings);
+		const auto data = exclusions->compile({ 1, 2 });
+
+		if (data.size() < HeaderSize + EntrySize * 2)
+		{
+			printf("FAIL: generated file too small to damage\n");
+			return false;
+		}
+
+		bool ok = true;
+		for (size_t size = 0; ok && size < data.size(); size++)
+			ok = rejects({ data.begin(), data.begin() + size }, "a truncated file");
+
+		auto damaged = data;
+		damaged.push_back(0);
+		ok = ok && rejects(damaged, "a file with a trailing byte");
+
+		damaged = data;
+		damaged[0] ^= 0x20;
+		ok = ok && rejects(damaged, "a file with a bad magic");
+
+		damaged = data;
+		damaged[4]++;
+		ok = ok && rejects(damaged, "a file with another version");
+
+		// On the last entry, so it's still in order
+		const size_t last = data.size() - EntrySize;
+		damaged = data;
+		damaged[last] = uint8_t(LodExclusions::MaxStages);
+		ok = ok && rejects(damaged, "an entry past the last stage");
+
+		damaged = data;
+		damaged[last + 2] = 0xFF;
+		damaged[last + 3] = 0xFF;
+		ok = ok && rejects(damaged, "an entry past the last node");
+
+		damaged = data;
+		memcpy(damaged.data() + HeaderSize + EntrySize, data.data() + HeaderSize, EntrySize);
+		ok = ok && rejects(damaged, "a repeated entry");
+
+		damaged = data;
+		memcpy(damaged.data() + HeaderSize, data.data() + HeaderSize + EntrySize, EntrySize);
+		memcpy(damaged.data() + HeaderSize + EntrySize, data.data() + HeaderSize, EntrySize);
+		ok = ok && rejects(damaged, "entries out of order");
+
+		if (ok)
+			printf("ok: every truncation and each kind of damage of %zu bytes is rejected\n", data.size());
+		return ok;
+	}
+
+	bool write_file(const std::filesystem::path& path, const std::string& text)
+	{
+		std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(text.data(), text.size());
+		return file.good();
+	}
+
+	// What the DLL checks before using a compiled file
+	bool stamps_go_stale()
+	{
+		const auto folder = std::filesystem::temp_directory_path();
+		const auto iniPath = folder / "lodcompile_selftest.ini";
+		const auto copyPath = folder / "lodcompile_selftest_copy.ini";
+
+		Expected expected;
+		std::string ini = generate_ini(11, expected);
+
+		LodExclusions::SourceStamp stamp, copyStamp, editedStamp, compiledStamp;
+		bool ok = write_file(iniPath, ini) && write_file(copyPath, ini) &&
+			LodExclusions::stamp_of(iniPath, stamp) && LodExclusions::stamp_of(copyPath, copyStamp);
+		if (!ok || !(stamp == copyStamp))
+		{
+			printf("FAIL: the same INI in two places stamps differently\n");
+			ok = false;
+		}
+
+		auto exclusions = std::make_unique<LodExclusions>();
+		std::vector<std::string> warnings;
+		const auto compiledPath = LodExclusions::compiled_path(iniPath);
+		if (ok && (!exclusions->read_ini(iniPath, warnings) || !exclusions->write_compiled(compiledPath, stamp) ||
+			!exclusions->read_compiled(compiledPath, compiledStamp) || !(compiledStamp == stamp)))
+		{
+			printf("FAIL: compiled file doesn't carry the INI's stamp\n");
+			ok = false;
+		}
+
+		// Same size, one digit different
+		const auto digit = ini.find_first_of("123456789", ini.find('['));
+		ini[digit] = ini[digit] == '9' ? '8' : char(ini[digit] + 1);
+		if (ok && (!write_file(iniPath, ini) || !LodExclusions::stamp_of(iniPath, editedStamp) || editedStamp == compiledStamp))
+		{
+			printf("FAIL: an edited INI still matches its old compiled file\n");
+			ok = false;
+		}
+
+		std::error_code ec;
+		std::filesystem::remove(iniPath, ec);
+		std::filesystem::remove(copyPath, ec);
+		std::filesystem::remove(compiledPath, ec);
+
+		if (ok)
+			printf("ok: stamps follow the INI's contents\n");
+		return ok;
+	}
+
+	int selftest()
+	{
+		bool ok = round_trips(1);
+		ok &= round_trips(2);
+		ok &= round_trips(3);
+
+		// Nothing but comments and blank lines loads as no exclusions
+		auto empty = std::make_unique<LodExclusions>();
+		std::vector<std::string> warnings;
+		empty->parse_ini("; nothing here\n\n# or here\n", warnings);
+		ok &= warnings.empty() && matches(*empty, {}, "comment-only INI");
+
+		ok &= skips_bad_lines();
+		ok &= rejects_damage();
+		ok &= stamps_go_stale();
+
+		printf(ok ? "selftest passed\n" : "selftest FAILED\n");
+		return ok ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool verify = false;
+	std::filesystem::path iniPath, outPath;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--selftest") == 0)
+			return selftest();
+		else if (strcmp(argv[i], "--verify") == 0)
+			verify = true;
+		else if (iniPath.empty())
+			iniPath = argv[i];
+		else if (outPath.empty())
+			outPath = argv[i];
+	}
+
+	if (iniPath.empty())
+	{
+		fprintf(stderr, "usage: lodcompile [--verify] <lods.ini> [output.bin]\n"
+			"       lodcompile --selftest\n");
+		return 2;
+	}
+
+	if (outPath.empty())
+		outPath = LodExclusions::compiled_path(iniPath);
+
+	LodExclusions::SourceStamp stamp;
+	if (!LodExclusions::stamp_of(iniPath, stamp))
+	{
+		fprintf(stderr, "lodcompile: can't open %s\n", iniPath.string().c_str());
+		return 1;
+	}
+
+	auto exclusions = std::make_unique<LodExclusions>();
+
+	std::vector<std::string> warnings;
+	if (!exclusions->read_ini(iniPath, warnings))
+	{
+		fprintf(stderr, "lodcompile: failed to read %s\n", iniPath.string().c_str());
+		return 1;
+	}
+
+	for (auto& warning : warnings)
+		fprintf(stderr, "%s: %s\n", iniPath.string().c_str(), warning.c_str());
+
+	if (!exclusions->write_compiled(outPath, stamp))
+	{
+		fprintf(stderr, "lodcompile: failed to write %s\n", outPath.string().c_str());
+		return 1;
+	}
+
+	if (verify)
+	{
+		auto reloaded = std::make_unique<LodExclusions>();
+		LodExclusions::SourceStamp reloadedStamp;
+		if (!reloaded->read_compiled(outPath, reloadedStamp) || !(reloadedStamp == stamp) ||
+			reloaded->compile(reloadedStamp) != exclusions->compile(stamp))
+		{
+			fprintf(stderr, "lodcompile: %s doesn't read back the same as %s\n",
+				outPath.string().c_str(), iniPath.string().c_str());
+			return 1;
+		}
+	}
+
+	printf("%s -> %s\n", iniPath.string().c_str(), outPath.string().c_str());
+	return 0;
+}